@@ -0,0 +1,34 @@
+#ifndef BUFF_VIEW_H
+#define BUFF_VIEW_H
+
+#include <cassert>
+
+// Which buff array GetBuff's slots 0-14 read from. The song window shares CBuffWindow's code, so while it refreshes or
+// shows spell info, slots 0-14 are redirected to BuffsExt (offset 15). Shared by eqgame.cpp and eqa_songs.cpp, each of
+// which defines CurrentBuffView. A plain global keeps the GetBuff hook to one cache-resident read (no TLS lookup); it's
+// only ever changed through ScopedBuffView, so nested refreshes or early returns always put back the previous view.
+struct BuffView {
+	const void* owner; // Window that set the view, nullptr for the default view. Only used to check nesting.
+	bool song_buffs;
+};
+extern BuffView CurrentBuffView;
+
+class ScopedBuffView {
+public:
+	ScopedBuffView(const void* owner, bool song_buffs) : previous(CurrentBuffView), owner(owner) {
+		CurrentBuffView.owner = owner;
+		CurrentBuffView.song_buffs = song_buffs;
+	}
+	~ScopedBuffView() {
+		// Views must unwind in reverse order, or this would put back the wrong one
+		assert(CurrentBuffView.owner == owner);
+		CurrentBuffView = previous;
+	}
+	ScopedBuffView(const ScopedBuffView&) = delete;
+	ScopedBuffView& operator=(const ScopedBuffView&) = delete;
+private:
+	BuffView previous;
+	const void* owner;
+};
+
+#endif // BUFF_VIEW_H
@@ -0,0 +1,48 @@
+#ifndef CALLBACK_REGISTRY_H
+#define CALLBACK_REGISTRY_H
+
+#include <windows.h>
+#include <cassert>
+#include <cstdio>
+
+// Fixed-size lists of plain function pointers, kept sorted by priority (lower runs first, ties keep registration order).
+// Shared by eqgame.cpp and eqa_songs.cpp. Filled once from InitHooks (before any event can fire), not at compile time,
+// since some registrations depend on what InitHooks finds. No constructor, so globals are zero-initialized before any
+// code runs and dispatch is just a loop of direct calls.
+enum CallbackPriority {
+	CallbackPriority_Early = -100,
+	CallbackPriority_Default = 0,
+	CallbackPriority_Late = 100,
+};
+
+template <typename Fn, size_t Capacity>
+struct CallbackRegistry {
+	struct Entry {
+		int priority;
+		Fn callback;
+	};
+	Entry entries[Capacity];
+	size_t count;
+
+	// A full registry is a bug (raise Capacity), so it asserts in debug builds and is reported in the debug output.
+	bool Add(Fn callback, int priority = CallbackPriority_Default) {
+		if (!callback)
+			return false;
+		if (count >= Capacity) {
+			char message[128];
+			_snprintf_s(message, sizeof(message), _TRUNCATE, "CallbackRegistry: capacity %u exceeded, callback %p not registered.\n", (unsigned)Capacity, (void*)callback);
+			OutputDebugStringA(message);
+			assert(!"CallbackRegistry capacity exceeded");
+			return false;
+		}
+		size_t i = count++;
+		for (; i > 0 && entries[i - 1].priority > priority; i--)
+			entries[i] = entries[i - 1];
+		entries[i] = { priority, callback };
+		return true;
+	}
+	const Entry* begin() const { return entries; }
+	const Entry* end() const { return entries + count; }
+};
+
+#endif // CALLBACK_REGISTRY_H
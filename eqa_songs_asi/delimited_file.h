@@ -0,0 +1,153 @@
+#ifndef DELIMITED_FILE_H
+#define DELIMITED_FILE_H
+
+#include <cstddef>
+#include <cstring>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Parser for the '^'-delimited data files eqgame.cpp loads (ZoneData.txt, RaceData.txt). Builds on Linux too
+// (tests/delimited_file_test.cpp), so the only platform code is the read-only mapping in MappedFile.
+
+// Read-only memory mapping of a whole file. Empty and missing files just aren't open.
+class MappedFile {
+public:
+	explicit MappedFile(const char* path) {
+#ifdef _WIN32
+		file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (file == INVALID_HANDLE_VALUE)
+			return;
+		LARGE_INTEGER file_size;
+		if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0 || file_size.HighPart != 0)
+			return; // Empty files can't be mapped, and nothing we load is anywhere near 4GB
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (!mapping)
+			return;
+		data = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		if (data)
+			size = (size_t)file_size.LowPart;
+#else
+		file = open(path, O_RDONLY);
+		if (file < 0)
+			return;
+		struct stat info;
+		if (fstat(file, &info) != 0 || info.st_size == 0)
+			return;
+		void* view = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+		if (view == MAP_FAILED)
+			return;
+		data = (const char*)view;
+		size = (size_t)info.st_size;
+#endif
+	}
+	~MappedFile() {
+#ifdef _WIN32
+		if (data)
+			UnmapViewOfFile(data);
+		if (mapping)
+			CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE)
+			CloseHandle(file);
+#else
+		if (data)
+			munmap((void*)data, size);
+		if (file >= 0)
+			close(file);
+#endif
+	}
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	const char* data = nullptr;
+	size_t size = 0;
+
+private:
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = NULL;
+#else
+	int file = -1;
+#endif
+};
+
+// A column of a DelimitedFile row: points into the mapped file, not NUL-terminated
+struct DelimitedField {
+	const char* text;
+	size_t length;
+
+	bool empty() const { return length == 0; }
+
+	// Same result as atoi() on the column, without copying it
+	int ToInt() const {
+		const char* p = text;
+		const char* end = text + length;
+		while (p < end && (*p == ' ' || *p == '\t'))
+			p++;
+		bool negative = p < end && *p == '-';
+		if (p < end && (*p == '-' || *p == '+'))
+			p++;
+		int value = 0;
+		for (; p < end && *p >= '0' && *p <= '9'; p++)
+			value = value * 10 + (*p - '0');
+		return negative ? -value : value;
+	}
+};
+
+// Rows are handed out as arrays of DelimitedField pointing into the mapping, so parsing allocates nothing.
+// Splits the same way the old std::getline parser did: CR/LF line endings, a trailing '^' doesn't add an empty column.
+class DelimitedFile {
+public:
+	static constexpr size_t MAX_COLUMNS = 16;
+
+	explicit DelimitedFile(const char* path) : file(path) {}
+
+	bool IsOpen() const { return file.data != nullptr; }
+
+	// Calls fn(const DelimitedField* columns, size_t column_count) for every line. column_count is the real number of
+	// columns even past MAX_COLUMNS (only the first MAX_COLUMNS are filled in), so 'column_count == N' checks stay exact.
+	template<typename Fn>
+	void ForEachRow(Fn fn, char delimiter = '^') const {
+		ForEachRow(file.data, file.size, fn, delimiter);
+	}
+
+	// Same, over text that is already in memory
+	template<typename Fn>
+	static void ForEachRow(const char* data, size_t size, Fn fn, char delimiter = '^') {
+		DelimitedField columns[MAX_COLUMNS];
+		const char* p = data;
+		const char* end = data + size;
+		while (p < end) {
+			const char* line_end = (const char*)memchr(p, '\n', end - p);
+			if (!line_end)
+				line_end = end;
+			const char* next_line = line_end < end ? line_end + 1 : end;
+			if (line_end > p && line_end[-1] == '\r')
+				line_end--;
+
+			size_t count = 0;
+			const char* field = p;
+			while (field < line_end) {
+				const char* field_end = (const char*)memchr(field, delimiter, line_end - field);
+				if (!field_end)
+					field_end = line_end;
+				if (count < MAX_COLUMNS)
+					columns[count] = { field, (size_t)(field_end - field) };
+				count++;
+				field = field_end + 1;
+			}
+			fn(columns, count);
+			p = next_line;
+		}
+	}
+
+private:
+	MappedFile file;
+};
+
+#endif // DELIMITED_FILE_H
@@ -1,15 +1,23 @@
 #include <windows.h>
 #include <cstdarg>
 #include <cstdio>
+#include <cctype>
+#include <cassert>
 #include <stdio.h>
 #include <string>
 #include <vector>
 #include <functional>
 #include <map>
+#include <queue>
 #include <algorithm>
+#include <intrin.h>
 #include "detours.h"
 #include "eqmac.h"
 #include "eqmac_functions.h"
+#include "callback_registry.h"
+#include "patch_transaction.h"
+#include "signature_scan.h"
+#include "buff_view.h"
 
 // Sent on zone entry to the server.
 // Server uses this to tell the user if they are out of date.
@@ -20,6 +28,13 @@
 #endif
 #define DLL_VERSION_MESSAGE_ID 4 // Matches ClientFeature::CodeVersion == 4 on the Server, do not change.
 
+// Per-hook timing (/hookstats) and trace capture (/trace). Compiled in, but both are off until turned on in game, and
+// then cost an rdtsc pair per hook call; while off each hook only tests two flags. Build with EQA_HOOK_STATS=0 to
+// compile both out entirely.
+#ifndef EQA_HOOK_STATS
+#define EQA_HOOK_STATS 1
+#endif
+
 //------------------------------------------------------------------------
 // Additions from eqgame.h
 //------------------------------------------------------------------------
@@ -39,7 +54,7 @@ void SendCustomSpawnAppearanceMessage(unsigned __int16 feature_id, unsigned __in
 __declspec(dllexport) class CShortBuffWindow* GetShortDurationBuffWindow();
 
 struct _EQBUFFINFO* GetStartBuffArray(bool song_buffs);
-void MakeGetBuffReturnSongs(bool enabled);
+int GetBuffWindowSlotCount(bool song_buffs);
 
 //------------------------------------------------------------------------
 // End of additions from eqgame.h
@@ -56,6 +71,16 @@ int  Rule_Num_Short_Buffs = 0;            // set by handshake
 int  Rule_Max_Buffs = EQ_NUM_BUFFS; // raised by handshake
 int g_buffWindowTimersFontSize = 3; // default tooltip/overlay font size
 bool g_bSongWindowAutoHide = false;
+int g_songWindowShowDelayMs = 0;    // how long a song must be up before the window is auto-shown
+int g_songWindowHideDelayMs = 0;    // how long the window must be empty before it is auto-hidden
+// Set once the handshake gives us song slots and the song window hooks (GetBuff redirect, WndNotification) are in.
+// Until then the song window is kept hidden: the client would fill it from the main buff slots, and a click would go
+// to the stock WndNotification and remove a real main buff.
+bool SongWindow_HooksInstalled = false;
+
+// ---------- Buff view ----------
+// Changed only through ScopedBuffView (buff_view.h)
+BuffView CurrentBuffView = { nullptr, false };
 
 // ---------- Tiny helpers used by WndNotification ----------
 static inline bool CtrlPressed() { return *(DWORD*)0x00809320 > 0; }
@@ -70,29 +95,105 @@ EQ_FUNCTION_TYPE_EQ_Character__CastSpell EQMACMQ_REAL_EQ_Character__CastSpell =
 
 // ---------- Callback registries ----------
 // Callbacks run on zone
-std::vector<std::function<void()>> OnZoneCallbacks;
-std::vector<std::function<void(CDisplay*)>> InitGameUICallbacks;
-std::vector<std::function<void()>> DeactivateUICallbacks;
-std::vector<std::function<void(char)>> ActivateUICallbacks;
-std::vector<std::function<void()>> CleanUpUICallbacks;
+CallbackRegistry<void(*)(), 8> OnZoneCallbacks;
+CallbackRegistry<void(*)(CDisplay*), 8> InitGameUICallbacks;
+CallbackRegistry<void(*)(), 8> DeactivateUICallbacks;
+CallbackRegistry<void(*)(char), 8> ActivateUICallbacks;
+CallbackRegistry<void(*)(), 8> CleanUpUICallbacks;
+// Callbacks run once per frame (from CDisplay::Render_World)
+CallbackRegistry<void(*)(), 8> OnPulseCallbacks;
 
 // Callbacks run on custom messages received via OP_SpawnAppearance
-std::vector<std::function<bool(DWORD feature_id, DWORD feature_value, bool is_request)>> CustomSpawnAppearanceMessageHandlers;
+CallbackRegistry<bool(*)(DWORD feature_id, DWORD feature_value, bool is_request), 8> CustomSpawnAppearanceMessageHandlers;
+
+// ---------- Address resolver ----------
+// Hook targets and the client globals we read are hard-coded for the current eqgame.exe. To survive a client rebuild,
+// each one is checked against a byte signature (./eqa_signatures.txt, written with /sigdump from a client where the
+// known addresses are right), and only used once it has been verified:
+//  1. ./eqa_addresses.cache, if it was written for this exact exe (PE timestamp, image size and checksum)
+//  2. The signature checked at the known address (cheap, the usual case)
+//  3. An SSE2 scan of .text for the signature, which must match exactly once
+// Anything else is left unresolved: Address() returns 0, whatever needs it is skipped, and the first zone-in lists it
+// in chat. Without a signatures file (a fresh install) there is nothing to check against, so the known addresses are
+// used as they are, same as eqclient.ini [Defaults] TrustKnownAddresses=TRUE; either way each one is logged as not
+// verified, and /sigdump can then write the file.
+// Data entries (client globals) have no code of their own to match, so their signature covers a code site that
+// references them, and the global's address is read out of that site's operand.
+// The cache is only written when every entry was verified, so warm startups skip 2 and 3. Must run before any hooks
+// are installed, since it also snapshots the original bytes at each target for /sigdump.
+enum AddressId {
+	Address_GetLabelFromEQ,
+	Address_EnterZone,
+	Address_HandleSpawnAppearanceMessage,
+	Address_InitGameUI,
+	Address_CleanUpUI,
+	Address_ActivateUI,
+	Address_DeactivateUI,
+	Address_RenderWorld,
+	Address_InterpretCmd,
+	Address_FindAffectSlot,
+	Address_GetBuff,
+	Address_GetMaxBuffs,
+	Address_WndNotification,
+	Address_BuffWindowScreenNamePush,
+	Address_OPBuffSlotLoop,
+	Address_CEverQuest,
+	Address_GameHeap,
+	Address_NewUIFlag,
+	Address_Count
+};
 
-// ---------- Patching helpers ----------
-// copies target original value to buffer, then copies source to the target
-void PatchSwap(int target, BYTE* source, SIZE_T size, BYTE* buffer = nullptr)
-{
-	DWORD oldprotect;
-	VirtualProtect((PVOID*)target, size, PAGE_EXECUTE_READWRITE, &oldprotect);
-	if (buffer)
-		memcpy((void*)buffer, (const void*)target, size);
-	memcpy((void*)target, (const void*)source, size);
-	FlushInstructionCache(GetCurrentProcess(), (void*)target, size);
-	VirtualProtect((PVOID*)target, size, oldprotect, &oldprotect);
+enum AddressKind {
+	AddressKind_Code,
+	AddressKind_Data,
+};
+
+constexpr size_t SIGNATURE_LENGTH = 24;
+constexpr size_t DATA_SITE_LEAD = 8; // A data entry's operand sits this far into its site signature
+struct AddressEntry {
+	const char* name;
+	AddressKind kind;
+	uintptr_t known;
+	uintptr_t resolved;              // 0 until verified, see Address()
+	uintptr_t site;                  // Where 'original' was read: the target itself, or the code referencing a global
+	BYTE original[SIGNATURE_LENGTH]; // Bytes at 'site' before we hooked it (for /sigdump)
+};
+AddressEntry AddressTable[Address_Count] = {
+	{ "GetLabelFromEQ", AddressKind_Code, 0x436680 },
+	{ "EnterZone", AddressKind_Code, 0x53D2C4 },
+	{ "HandleSpawnAppearanceMessage", AddressKind_Code, 0x004DF52A },
+	{ "InitGameUI", AddressKind_Code, 0x004a60b5 },
+	{ "CleanUpUI", AddressKind_Code, 0x004A6EBC },
+	{ "ActivateUI", AddressKind_Code, 0x004A741B },
+	{ "DeactivateUI", AddressKind_Code, 0x4A7705 },
+	{ "RenderWorld", AddressKind_Code, 0x004AA8BC },
+	{ "InterpretCmd", AddressKind_Code, EQ_FUNCTION_CEverQuest__InterpretCmd },
+	{ "FindAffectSlot", AddressKind_Code, 0x004C7A3E },
+	{ "GetBuff", AddressKind_Code, 0x004C465A },
+	{ "GetMaxBuffs", AddressKind_Code, 0x004C4637 },
+	{ "WndNotification", AddressKind_Code, 0x00408FF1 },
+	{ "BuffWindowScreenNamePush", AddressKind_Code, 0x00408D5A },
+	{ "OPBuffSlotLoop", AddressKind_Code, 0x004E9F8E },
+	{ "CEverQuest", AddressKind_Data, EQ_POINTER_CEverQuest }, // Chat output goes through it
+	{ "GameHeap", AddressKind_Data, 0x0080B420 },              // HANDLE the client allocates its windows from
+	{ "NewUIFlag", AddressKind_Data, 0x008092D8 },             // BYTE, non-zero when the new UI is in use
+};
+const char* AddressCacheFile = "./eqa_addresses.cache";
+const char* AddressSignatureFile = "./eqa_signatures.txt";
+
+// 0 if the entry couldn't be verified for this exe; callers skip whatever needs it
+inline uintptr_t Address(AddressId id) {
+	return AddressTable[id].resolved;
+}
+
+// DetourFunction on a verified target, or nullptr (hook skipped) if it isn't one
+PBYTE DetourAddress(AddressId id, PBYTE detour) {
+	uintptr_t target = Address(id);
+	return target ? DetourFunction((PBYTE)target, detour) : nullptr;
 }
 
 // ---------- Print to Chat Window Wrapper ----------
+// Goes to the debug output instead until CEverQuest is known.
 typedef void(__thiscall* PrintChat)(int this_ptr, const char* data, short color, bool un);
 void print_chat(const char* format, ...)
 {
@@ -102,9 +203,506 @@ void print_chat(const char* format, ...)
 	va_start(argptr, format);
 	vsnprintf(buffer, 511, format, argptr);
 	va_end(argptr);
-	print_chat_internal(*(int*)0x809478, buffer, 0, true);
+	uintptr_t everquest = Address(Address_CEverQuest);
+	if (!everquest || !*(int*)everquest) {
+		strcat_s(buffer, "\n");
+		OutputDebugStringA(buffer);
+		return;
+	}
+	print_chat_internal(*(int*)everquest, buffer, 0, true);
+}
+
+struct ImageInfo {
+	uintptr_t begin;
+	uintptr_t end;
+	const BYTE* text_begin;
+	const BYTE* text_end;
+	DWORD timestamp;
+	DWORD checksum;
+};
+
+bool GetImageInfo(ImageInfo& info)
+{
+	BYTE* base = (BYTE*)GetModuleHandleA(nullptr);
+	IMAGE_DOS_HEADER* dos = (IMAGE_DOS_HEADER*)base;
+	if (!base || dos->e_magic != IMAGE_DOS_SIGNATURE)
+		return false;
+	IMAGE_NT_HEADERS* nt = (IMAGE_NT_HEADERS*)(base + dos->e_lfanew);
+	if (nt->Signature != IMAGE_NT_SIGNATURE)
+		return false;
+
+	info.begin = (uintptr_t)base;
+	info.end = info.begin + nt->OptionalHeader.SizeOfImage;
+	info.timestamp = nt->FileHeader.TimeDateStamp;
+	info.checksum = nt->OptionalHeader.CheckSum;
+	info.text_begin = info.text_end = nullptr;
+	IMAGE_SECTION_HEADER* section = IMAGE_FIRST_SECTION(nt);
+	for (WORD i = 0; i < nt->FileHeader.NumberOfSections; i++, section++) {
+		if (memcmp(section->Name, ".text", 6) == 0) {
+			info.text_begin = base + section->VirtualAddress;
+			info.text_end = info.text_begin + section->Misc.VirtualSize;
+		}
+	}
+	return info.text_begin != nullptr;
+}
+
+bool AddressCache_Load(const ImageInfo& image)
+{
+	FILE* file = nullptr;
+	if (fopen_s(&file, AddressCacheFile, "r") != 0 || !file)
+		return false;
+
+	char line[256];
+	unsigned int timestamp = 0, size = 0, checksum = 0;
+	bool valid = fgets(line, sizeof(line), file)
+		&& sscanf_s(line, "exe %x %x %x", &timestamp, &size, &checksum) == 3
+		&& timestamp == image.timestamp && size == image.end - image.begin && checksum == image.checksum;
+	int loaded = 0;
+	while (valid && fgets(line, sizeof(line), file)) {
+		char name[64];
+		unsigned int address = 0, site = 0;
+		if (sscanf_s(line, "%63s %x %x", name, (unsigned)sizeof(name), &address, &site) != 3)
+			continue;
+		for (auto& entry : AddressTable) {
+			if (strcmp(entry.name, name) == 0 && address >= image.begin && address < image.end
+				&& site >= (uintptr_t)image.text_begin && site + SIGNATURE_LENGTH <= (uintptr_t)image.text_end) {
+				entry.resolved = address;
+				entry.site = site;
+				loaded++;
+			}
+		}
+	}
+	fclose(file);
+	return valid && loaded == Address_Count;
+}
+
+void AddressCache_Save(const ImageInfo& image)
+{
+	FILE* file = nullptr;
+	if (fopen_s(&file, AddressCacheFile, "w") != 0 || !file)
+		return;
+	fprintf(file, "exe %08X %08X %08X\n", image.timestamp, (unsigned)(image.end - image.begin), image.checksum);
+	for (auto& entry : AddressTable)
+		fprintf(file, "%s %08X %08X\n", entry.name, (unsigned)entry.resolved, (unsigned)entry.site);
+	fclose(file);
+}
+
+std::map<std::string, Signature> AddressSignatures_Load()
+{
+	std::map<std::string, Signature> signatures;
+	FILE* file = nullptr;
+	if (fopen_s(&file, AddressSignatureFile, "r") != 0 || !file)
+		return signatures;
+	char line[512];
+	while (fgets(line, sizeof(line), file)) {
+		char name[64];
+		int consumed = 0;
+		if (line[0] == '#' || sscanf_s(line, "%63s %n", name, (unsigned)sizeof(name), &consumed) != 1 || consumed == 0)
+			continue;
+		Signature signature = Signature_FromString(line + consumed);
+		if (!signature.empty())
+			signatures[name] = signature;
+	}
+	fclose(file);
+	return signatures;
+}
+
+// First place in .text that holds 'value' as an operand, backed up DATA_SITE_LEAD bytes to where its signature starts
+const BYTE* AddressResolver_FindDataSite(const ImageInfo& image, uintptr_t value)
+{
+	for (const BYTE* p = image.text_begin + DATA_SITE_LEAD; p + SIGNATURE_LENGTH - DATA_SITE_LEAD <= image.text_end; p++) {
+		if (*(const DWORD*)p == (DWORD)value)
+			return p - DATA_SITE_LEAD;
+	}
+	return nullptr;
+}
+
+// Sets 'resolved' and 'site' if the signature holds up, see the resolution order above
+bool AddressResolver_Verify(AddressEntry& entry, const Signature& signature, const ImageInfo& image)
+{
+	if (entry.kind == AddressKind_Code) {
+		if (entry.known >= (uintptr_t)image.text_begin && entry.known + signature.size() <= (uintptr_t)image.text_end && Signature_Matches((const BYTE*)entry.known, signature)) {
+			entry.resolved = entry.site = entry.known;
+			return true;
+		}
+		const BYTE* found = Signature_Scan(image.text_begin, image.text_end, signature);
+		if (!found)
+			return false;
+		entry.resolved = entry.site = (uintptr_t)found;
+		return true;
+	}
+
+	if (signature.size() < DATA_SITE_LEAD + 4)
+		return false;
+	const BYTE* found = Signature_Scan(image.text_begin, image.text_end, signature);
+	if (!found)
+		return false;
+	uintptr_t value = *(const DWORD*)(found + DATA_SITE_LEAD);
+	if (value < image.begin || value >= image.end)
+		return false;
+	entry.resolved = value;
+	entry.site = (uintptr_t)found;
+	return true;
+}
+
+void AddressResolver_Init()
+{
+	for (auto& entry : AddressTable)
+		entry.resolved = entry.site = 0;
+
+	ImageInfo image;
+	if (!GetImageInfo(image)) {
+		OutputDebugStringA("AddressResolver: Could not read the eqgame.exe image, nothing will be hooked.\n");
+		return;
+	}
+
+	if (!AddressCache_Load(image)) {
+		char trust[16];
+		GetPrivateProfileStringA("Defaults", "TrustKnownAddresses", "FALSE", trust, sizeof(trust), "./eqclient.ini");
+		std::map<std::string, Signature> signatures = AddressSignatures_Load();
+		bool trust_known = strcmp(trust, "TRUE") == 0 || signatures.empty();
+		int verified = 0;
+		for (auto& entry : AddressTable) {
+			entry.resolved = entry.site = 0; // Whatever a stale cache left behind
+			auto it = signatures.find(entry.name);
+			if (it != signatures.end() && AddressResolver_Verify(entry, it->second, image)) {
+				verified++;
+				continue;
+			}
+			if (trust_known) {
+				entry.resolved = entry.known;
+				entry.site = entry.kind == AddressKind_Code ? entry.known : (uintptr_t)AddressResolver_FindDataSite(image, entry.known);
+			}
+			char message[192];
+			_snprintf_s(message, sizeof(message), _TRUNCATE, "AddressResolver: %s (%08X) not verified, %s.\n", entry.name, (unsigned)entry.known,
+				!trust_known ? "skipping what needs it" : signatures.empty() ? "using the known address (no signatures file)" : "using the known address (TrustKnownAddresses)");
+			OutputDebugStringA(message);
+		}
+		if (verified == Address_Count)
+			AddressCache_Save(image);
+	}
+
+	for (auto& entry : AddressTable) {
+		if (entry.site)
+			memcpy(entry.original, (const void*)entry.site, SIGNATURE_LENGTH);
+	}
+}
+
+// Lists anything left unresolved in chat once, on the first zone-in (chat isn't up when AddressResolver_Init runs)
+bool AddressResolver_Warned = false;
+void AddressResolver_OnZone()
+{
+	if (AddressResolver_Warned)
+		return;
+	AddressResolver_Warned = true;
+	for (auto& entry : AddressTable) {
+		if (!entry.resolved)
+			print_chat("Warning: %s could not be verified for this eqgame.exe (see %s), what needs it is turned off.", entry.name, AddressSignatureFile);
+	}
+}
+
+// /sigdump - Writes signatures for every target, from the bytes they had before we hooked them
+void AddressResolver_HandleSigDump()
+{
+	ImageInfo image;
+	FILE* file = nullptr;
+	if (!GetImageInfo(image) || fopen_s(&file, AddressSignatureFile, "w") != 0 || !file) {
+		print_chat("Could not write %s.", AddressSignatureFile);
+		return;
+	}
+	fprintf(file, "# name signature (generated by /sigdump, exe %08X)\n", image.timestamp);
+	int written = 0;
+	for (auto& entry : AddressTable) {
+		if (!entry.site) {
+			print_chat("Skipped %s: no verified address to learn it from.", entry.name);
+			continue;
+		}
+		fprintf(file, "%s %s\n", entry.name, Signature_ToString(Signature_Learn(entry.original, SIGNATURE_LENGTH, image.begin, image.end)).c_str());
+		written++;
+	}
+	fclose(file);
+	print_chat("Wrote %d signatures to %s.", written, AddressSignatureFile);
+}
+
+// ---------- Hook stats ----------
+// Each hook gets a fixed slot with a call count and a log2 histogram of its cost in TSC cycles (bucket i holds
+// [2^i, 2^(i+1)) cycles). Recording is an rdtsc pair and a few adds; cycles are only turned into time when printing,
+// using the TSC rate measured against QPC since the last reset. Off by default ('/hookstats on').
+// GetBuff is timed in both its detour and inline versions (/getbuff). It's the hottest hook and does very little, so
+// while stats are on its numbers are mostly the timer's own rdtsc pair; use them for call counts and outliers, and
+// compare the two versions on frame times with stats off.
+enum HookId {
+	HookId_RefreshBuffDisplay,
+	HookId_PostDraw,
+	HookId_FindAffectSlot,
+	HookId_GetLabelFromEQ,
+	HookId_HandleSpawnAppearanceMessage,
+	HookId_InterpretCmd,
+	HookId_GetBuff,
+	HookId_Count
+};
+const char* HookNames[HookId_Count] = {
+	"RefreshBuffDisplay",
+	"PostDraw",
+	"FindAffectSlot",
+	"GetLabelFromEQ",
+	"HandleSpawnAppearanceMessage",
+	"InterpretCmd",
+	"GetBuff",
+};
+
+#if EQA_HOOK_STATS
+constexpr int HOOK_STATS_BUCKETS = 48;
+struct HookStats {
+	unsigned __int64 calls;
+	unsigned __int64 max_cycles;
+	DWORD buckets[HOOK_STATS_BUCKETS];
+};
+HookStats HookStatsTable[HookId_Count];
+bool HookStats_Enabled = false;
+LARGE_INTEGER HookStats_ResetQpc;
+unsigned __int64 HookStats_ResetTsc = 0;
+
+inline void HookStats_Record(HookId id, unsigned __int64 cycles)
+{
+	HookStats& stats = HookStatsTable[id];
+	stats.calls++;
+	if (cycles > stats.max_cycles)
+		stats.max_cycles = cycles;
+	unsigned long bucket = 0;
+	unsigned long high = (unsigned long)(cycles >> 32);
+	if (high) {
+		_BitScanReverse(&bucket, high);
+		bucket += 32;
+	}
+	else if (!_BitScanReverse(&bucket, (unsigned long)cycles)) {
+		bucket = 0;
+	}
+	if (bucket >= HOOK_STATS_BUCKETS)
+		bucket = HOOK_STATS_BUCKETS - 1;
+	stats.buckets[bucket]++;
+}
+
+// ---------- Trace capture ----------
+// '/trace start' records a span for every hook and callback dispatch, plus one per frame (Render_World to Render_World),
+// into a buffer allocated up front. '/trace stop' (or a full buffer) writes it out as Chrome trace-event JSON, which
+// opens in chrome://tracing or ui.perfetto.dev.
+struct TraceEvent {
+	const char* name;
+	unsigned __int64 start;
+	unsigned __int64 end;
+};
+constexpr size_t TRACE_MAX_EVENTS = 1 << 18;
+TraceEvent* TraceEvents = nullptr;
+size_t TraceEventCount = 0;
+bool Trace_Capturing = false;
+unsigned __int64 Trace_FrameStart = 0;
+LARGE_INTEGER Trace_StartQpc;
+unsigned __int64 Trace_StartTsc = 0;
+
+void Trace_Stop();
+
+inline void Trace_Record(const char* name, unsigned __int64 start, unsigned __int64 end)
+{
+	if (TraceEventCount >= TRACE_MAX_EVENTS)
+		return;
+	TraceEvent& event = TraceEvents[TraceEventCount++];
+	event.name = name;
+	event.start = start;
+	event.end = end;
+}
+
+// Called at the top of every Render_World; closes the previous frame's span
+void Trace_OnFrame()
+{
+	if (!Trace_Capturing)
+		return;
+	unsigned __int64 now = __rdtsc();
+	if (Trace_FrameStart)
+		Trace_Record("Frame", Trace_FrameStart, now);
+	Trace_FrameStart = now;
+	if (TraceEventCount >= TRACE_MAX_EVENTS)
+		Trace_Stop();
+}
+
+class TraceScope {
+public:
+	explicit TraceScope(const char* name) : name(name), start(Trace_Capturing ? __rdtsc() : 0) {}
+	~TraceScope() {
+		if (start && Trace_Capturing)
+			Trace_Record(name, start, __rdtsc());
+	}
+	TraceScope(const TraceScope&) = delete;
+	TraceScope& operator=(const TraceScope&) = delete;
+private:
+	const char* name;
+	unsigned __int64 start;
+};
+#define TRACE_SPAN(name) TraceScope trace_scope_(name)
+
+void Trace_Start()
+{
+	if (Trace_Capturing)
+		return;
+	if (!TraceEvents)
+		TraceEvents = (TraceEvent*)VirtualAlloc(nullptr, TRACE_MAX_EVENTS * sizeof(TraceEvent), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+	if (!TraceEvents) {
+		print_chat("Trace: could not allocate the capture buffer.");
+		return;
+	}
+	TraceEventCount = 0;
+	Trace_FrameStart = 0;
+	QueryPerformanceCounter(&Trace_StartQpc);
+	Trace_StartTsc = __rdtsc();
+	Trace_Capturing = true;
+	print_chat("Trace: capturing (up to %u events). Type /trace stop to save.", (unsigned)TRACE_MAX_EVENTS);
+}
+
+void Trace_Stop()
+{
+	if (!Trace_Capturing)
+		return;
+	Trace_Capturing = false;
+
+	LARGE_INTEGER now, frequency;
+	QueryPerformanceCounter(&now);
+	QueryPerformanceFrequency(&frequency);
+	double us = (double)(now.QuadPart - Trace_StartQpc.QuadPart) * 1000000.0 / frequency.QuadPart;
+	double cycles_per_us = us > 0.0 ? (double)(__rdtsc() - Trace_StartTsc) / us : 1.0;
+
+	char filename[MAX_PATH];
+	SYSTEMTIME time;
+	GetLocalTime(&time);
+	_snprintf_s(filename, sizeof(filename), _TRUNCATE, "./eqa_trace_%04d%02d%02d_%02d%02d%02d.json",
+		time.wYear, time.wMonth, time.wDay, time.wHour, time.wMinute, time.wSecond);
+	FILE* file = nullptr;
+	if (fopen_s(&file, filename, "w") != 0 || !file) {
+		print_chat("Trace: could not write %s.", filename);
+		return;
+	}
+
+	DWORD pid = GetCurrentProcessId();
+	DWORD tid = GetCurrentThreadId();
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	for (size_t i = 0; i < TraceEventCount; i++) {
+		const TraceEvent& event = TraceEvents[i];
+		fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%lu,\"tid\":%lu,\"ts\":%.3f,\"dur\":%.3f}\n",
+			i ? "," : "", event.name, pid, tid,
+			(double)(event.start - Trace_StartTsc) / cycles_per_us,
+			(double)(event.end - event.start) / cycles_per_us);
+	}
+	fprintf(file, "]}\n");
+	fclose(file);
+	print_chat("Trace: wrote %u events to %s.", (unsigned)TraceEventCount, filename);
+}
+
+// /trace <start|stop>
+void Trace_HandleCommand(const char* args)
+{
+	while (*args == ' ')
+		args++;
+	if (_stricmp(args, "start") == 0)
+		Trace_Start();
+	else if (_stricmp(args, "stop") == 0)
+		Trace_Stop();
+	else
+		print_chat("Usage: /trace <start|stop> (%s)", Trace_Capturing ? "capturing" : "idle");
+}
+
+// The flags are checked once, when the hook is entered; with both off, no rdtsc is issued at all.
+class HookTimer {
+public:
+	explicit HookTimer(HookId id) : id(id), start(HookStats_Enabled || Trace_Capturing ? __rdtsc() : 0) {}
+	~HookTimer() {
+		if (!start)
+			return;
+		unsigned __int64 end = __rdtsc();
+		if (HookStats_Enabled)
+			HookStats_Record(id, end - start);
+		if (Trace_Capturing)
+			Trace_Record(HookNames[id], start, end);
+	}
+	HookTimer(const HookTimer&) = delete;
+	HookTimer& operator=(const HookTimer&) = delete;
+private:
+	HookId id;
+	unsigned __int64 start;
+};
+#define HOOK_TIMER(id) HookTimer hook_timer_(id)
+
+void HookStats_Reset()
+{
+	memset(HookStatsTable, 0, sizeof(HookStatsTable));
+	QueryPerformanceCounter(&HookStats_ResetQpc);
+	HookStats_ResetTsc = __rdtsc();
 }
 
+// Upper edge (in cycles) of the bucket holding the given fraction of calls
+unsigned __int64 HookStats_Percentile(const HookStats& stats, double fraction)
+{
+	unsigned __int64 target = (unsigned __int64)(stats.calls * fraction);
+	unsigned __int64 seen = 0;
+	for (int i = 0; i < HOOK_STATS_BUCKETS; i++) {
+		seen += stats.buckets[i];
+		if (seen > target)
+			return 2ull << i;
+	}
+	return stats.max_cycles;
+}
+
+// /hookstats [on|off|reset]
+void HookStats_HandleCommand(const char* args)
+{
+	while (*args == ' ')
+		args++;
+	if (_stricmp(args, "reset") == 0) {
+		HookStats_Reset();
+		print_chat("Hook stats reset.");
+		return;
+	}
+	if (_stricmp(args, "on") == 0 || _stricmp(args, "off") == 0) {
+		bool enable = _stricmp(args, "on") == 0;
+		if (enable && !HookStats_Enabled)
+			HookStats_Reset();
+		HookStats_Enabled = enable;
+		print_chat("Hook stats: %s.", enable ? "ON" : "OFF");
+		return;
+	}
+	if (!HookStats_Enabled) {
+		print_chat("Hook stats are off. Usage: /hookstats [on|off|reset]");
+		return;
+	}
+
+	LARGE_INTEGER now, frequency;
+	QueryPerformanceCounter(&now);
+	QueryPerformanceFrequency(&frequency);
+	double seconds = (double)(now.QuadPart - HookStats_ResetQpc.QuadPart) / frequency.QuadPart;
+	if (seconds <= 0.0) {
+		print_chat("Hook stats: nothing recorded yet.");
+		return;
+	}
+	double cycles_per_us = (double)(__rdtsc() - HookStats_ResetTsc) / (seconds * 1000000.0);
+
+	print_chat("Hook stats over %.0f seconds (p50 / p99 / max):", seconds);
+	for (int i = 0; i < HookId_Count; i++) {
+		const HookStats& stats = HookStatsTable[i];
+		if (stats.calls == 0)
+			continue;
+		print_chat("%s: %llu calls (%.0f/s) %.2f / %.2f / %.2f us", HookNames[i], stats.calls, stats.calls / seconds,
+			HookStats_Percentile(stats, 0.50) / cycles_per_us,
+			HookStats_Percentile(stats, 0.99) / cycles_per_us,
+			stats.max_cycles / cycles_per_us);
+	}
+}
+#else
+#define HOOK_TIMER(id) ((void)0)
+#define TRACE_SPAN(name) ((void)0)
+void HookStats_Reset() {}
+void HookStats_HandleCommand(const char*) { print_chat("Hook stats are not compiled into this build."); }
+void Trace_OnFrame() {}
+void Trace_HandleCommand(const char*) { print_chat("Trace capture is not compiled into this build."); }
+#endif
+
 // ---------- Callback helpers ----------
 
 // Helper - Executes all callbacks in 'OnZoneCallbacks'
@@ -112,8 +710,11 @@ typedef void(__thiscall* EQ_FUNCTION_TYPE_EnterZone)(void* this_ptr, int hwnd);
 EQ_FUNCTION_TYPE_EnterZone EnterZone_Trampoline;
 void __fastcall EnterZone_Detour(void* this_ptr, int unused, int hwnd) {
 	EnterZone_Trampoline(this_ptr, hwnd);
-	for (auto& callback : OnZoneCallbacks) {
-		callback();
+	{
+		TRACE_SPAN("OnZoneCallbacks");
+		for (auto& entry : OnZoneCallbacks) {
+			entry.callback();
+		}
 	}
 }
 
@@ -123,8 +724,11 @@ EQ_FUNCTION_TYPE_InitGameUI InitGameUI_Trampoline;
 int __fastcall InitGameUI_Detour(CDisplay* cdisplay, int unused)
 {
 	int res = InitGameUI_Trampoline(cdisplay);
-	for (auto& callback : InitGameUICallbacks) {
-		callback(cdisplay);
+	{
+		TRACE_SPAN("InitGameUICallbacks");
+		for (auto& entry : InitGameUICallbacks) {
+			entry.callback(cdisplay);
+		}
 	}
 	return res;
 }
@@ -135,8 +739,11 @@ EQ_FUNCTION_TYPE_CleanUpUI CleanUpUI_Trampoline;
 void* CleanUpUI_Detour()
 {
 	void* res = CleanUpUI_Trampoline();
-	for (auto& callback : CleanUpUICallbacks) {
-		callback();
+	{
+		TRACE_SPAN("CleanUpUICallbacks");
+		for (auto& entry : CleanUpUICallbacks) {
+			entry.callback();
+		}
 	}
 	return res;
 }
@@ -147,8 +754,11 @@ EQ_FUNCTION_TYPE_ActivateUI ActivateUI_Trampoline;
 int __stdcall ActivateUI_Detour(char a1)
 {
 	int res = ActivateUI_Trampoline(a1);
-	for (auto& callback : ActivateUICallbacks) {
-		callback(a1);
+	{
+		TRACE_SPAN("ActivateUICallbacks");
+		for (auto& entry : ActivateUICallbacks) {
+			entry.callback(a1);
+		}
 	}
 	return res;
 }
@@ -158,12 +768,29 @@ typedef int(*EQ_FUNCTION_TYPE_DeactivateUI)(void);
 EQ_FUNCTION_TYPE_DeactivateUI DeactivateUI_Trampoline;
 int DeactivateUI_Detour() {
 	int res = DeactivateUI_Trampoline();
-	for (auto& callback : DeactivateUICallbacks) {
-		callback();
+	{
+		TRACE_SPAN("DeactivateUICallbacks");
+		for (auto& entry : DeactivateUICallbacks) {
+			entry.callback();
+		}
 	}
 	return res;
 }
 
+// Helper - Executes all callbacks in 'OnPulseCallbacks'
+typedef int(__thiscall* EQ_FUNCTION_TYPE_RenderWorld)(void* this_ptr);
+EQ_FUNCTION_TYPE_RenderWorld RenderWorld_Trampoline;
+int __fastcall RenderWorld_Detour(void* this_ptr, int unused) {
+	Trace_OnFrame();
+	{
+		TRACE_SPAN("OnPulseCallbacks");
+		for (auto& entry : OnPulseCallbacks) {
+			entry.callback();
+		}
+	}
+	return RenderWorld_Trampoline(this_ptr);
+}
+
 // Helper - Sends custom key/value data to the server using OP_SpawnAppearance (type = 256)
 void SendCustomSpawnAppearanceMessage(unsigned __int16 feature_id, unsigned __int16 feature_value, bool is_request) {
 
@@ -189,8 +816,9 @@ void HandleCustomSpawnAppearanceMessage(SpawnAppearance_Struct* message)
 		bool is_request = (message->parameter >> 31) == 0;
 		DWORD feature_id = message->parameter >> 16 & 0x7FFFu;
 		DWORD feature_value = message->parameter & 0xFFFFu;
-		for (auto& handler : CustomSpawnAppearanceMessageHandlers) {
-			if (handler(feature_id, feature_value, is_request)) {
+		TRACE_SPAN("CustomSpawnAppearanceMessageHandlers");
+		for (auto& entry : CustomSpawnAppearanceMessageHandlers) {
+			if (entry.callback(feature_id, feature_value, is_request)) {
 				return;
 			}
 		}
@@ -200,6 +828,7 @@ void HandleCustomSpawnAppearanceMessage(SpawnAppearance_Struct* message)
 typedef int(__thiscall* EQ_FUNCTION_TYPE_HandleSpawnAppearanceMessage)(void* this_ptr, int unk2, int opcode, SpawnAppearance_Struct* sa);
 EQ_FUNCTION_TYPE_HandleSpawnAppearanceMessage HandleSpawnAppearanceMessage_Trampoline;
 int __fastcall HandleSpawnAppearanceMessage_Detour(void* this_ptr, int unused_edx, int unk2, int opcode, SpawnAppearance_Struct* sa) {
+	HOOK_TIMER(HookId_HandleSpawnAppearanceMessage);
 	if (sa->type >= SpawnAppearanceType_ClientDllMessage) {
 		HandleCustomSpawnAppearanceMessage(sa);
 		return 1;
@@ -207,10 +836,350 @@ int __fastcall HandleSpawnAppearanceMessage_Detour(void* this_ptr, int unused_ed
 	return HandleSpawnAppearanceMessage_Trampoline(this_ptr, unk2, opcode, sa);
 }
 
+// ---------- Buff countdown timers ----------
+// The server only updates EQBUFFINFO::Ticks (6 seconds each). We remember when each slot's ticks last changed,
+// and interpolate from EqGetTime() so timers can count down every second without any extra buff window refreshes.
+// Tick changes are picked up once per frame and by every buff window refresh, not when a timer happens to be read,
+// so the countdown doesn't depend on when the window was last drawn.
+constexpr int BUFF_TICK_MS = 6000;
+struct BuffCountdown {
+	WORD spell_id;
+	WORD ticks;
+	__int64 tick_time; // EqGetTime() when 'ticks' was first seen
+};
+BuffCountdown BuffCountdowns[EQ_NUM_BUFFS * 2]; // Buff[0-14], then BuffsExt[0-14]
+
+// Records the time of any tick (or spell) change in one buff array.
+void BuffCountdown_Update(bool song_buffs)
+{
+	_EQBUFFINFO* buffs = GetStartBuffArray(song_buffs);
+	BuffCountdown* timers = BuffCountdowns + (song_buffs ? EQ_NUM_BUFFS : 0);
+	__int64 now = 0;
+	for (int i = 0; i < EQ_NUM_BUFFS; i++)
+	{
+		if (timers[i].spell_id == buffs[i].SpellId && timers[i].ticks == buffs[i].Ticks)
+			continue;
+		if (!now)
+			now = EqGetTime();
+		timers[i].spell_id = buffs[i].SpellId;
+		timers[i].ticks = buffs[i].Ticks;
+		timers[i].tick_time = now;
+	}
+}
+
+// Runs every frame
+void BuffCountdown_Pulse()
+{
+	if (!EQ_OBJECT_CharInfo)
+		return;
+	BuffCountdown_Update(false);
+	BuffCountdown_Update(true);
+}
+
+// Returns the estimated milliseconds left on a buff slot (0 if it has no timer).
+int BuffCountdown_GetRemainingMs(bool song_buffs, int slot)
+{
+	EQBUFFINFO& buff = GetStartBuffArray(song_buffs)[slot];
+	const BuffCountdown& timer = BuffCountdowns[slot + (song_buffs ? EQ_NUM_BUFFS : 0)];
+	if (buff.Ticks == 0)
+		return 0;
+	if (timer.spell_id != buff.SpellId || timer.ticks != buff.Ticks) // Changed since the last update, so it's brand new
+		return (int)buff.Ticks * BUFF_TICK_MS;
+
+	__int64 now = EqGetTime();
+	__int64 remaining = (__int64)buff.Ticks * BUFF_TICK_MS - (now - timer.tick_time);
+	__int64 next_tick = (__int64)(buff.Ticks - 1) * BUFF_TICK_MS;
+	if (remaining < next_tick) // Server tick is late, hold until it arrives instead of running ahead
+		remaining = next_tick;
+	return (int)remaining;
+}
+
+// Same format as EQ_GetShortTickTimeString, but from milliseconds (rounded up to the second).
+void BuffCountdown_GetShortTimeString(int ms, char result[], size_t resultSize)
+{
+	int seconds = (ms + 999) / 1000;
+	if (seconds >= 60 * 60)
+		_snprintf_s(result, resultSize, _TRUNCATE, "%dh", seconds / (60 * 60));
+	else if (seconds >= 60)
+		_snprintf_s(result, resultSize, _TRUNCATE, "%dm", seconds / 60);
+	else if (seconds > 0)
+		_snprintf_s(result, resultSize, _TRUNCATE, "%ds", seconds);
+	else if (resultSize > 0)
+		result[0] = '\0';
+}
+
+// ---------- Buff expiry alerts ----------
+// Warns (chat, sound or taskbar flash) when a chosen buff or song is about to fade. Expiry predictions live in a
+// min-heap that is only pushed to when a slot's spell changes or it gets refreshed, so each frame just peeks the top.
+// Entries aren't removed when a slot changes; the slot's generation is bumped instead and stale entries are skipped.
+enum BuffAlertKind : BYTE {
+	BuffAlert_Chat,
+	BuffAlert_Sound,
+	BuffAlert_Flash,
+};
+const char* BuffAlertKindNames[] = { "chat", "sound", "flash" };
+
+struct BuffAlertRule {
+	WORD spell_id;
+	int lead_seconds;
+	BuffAlertKind kind;
+};
+std::vector<BuffAlertRule> BuffAlertRules; // /buffalert, saved to eqclient.ini [Defaults] BuffAlerts
+constexpr int BUFF_ALERT_MAX_LEAD_SECONDS = 0xFFFF * (BUFF_TICK_MS / 1000); // Longest a buff can last (Ticks is a WORD)
+
+struct BuffAlertSlot {
+	WORD spell_id;
+	WORD ticks;
+	DWORD generation;
+};
+BuffAlertSlot BuffAlertSlots[EQ_NUM_BUFFS * 2]; // Buff[0-14], then BuffsExt[0-14]
+
+struct BuffAlertEvent {
+	__int64 fire_time;
+	int slot;
+	DWORD generation;
+	bool operator>(const BuffAlertEvent& other) const { return fire_time > other.fire_time; }
+};
+std::priority_queue<BuffAlertEvent, std::vector<BuffAlertEvent>, std::greater<BuffAlertEvent>> BuffAlertQueue;
+
+const BuffAlertRule* BuffAlert_FindRule(WORD spell_id) {
+	for (auto& rule : BuffAlertRules) {
+		if (rule.spell_id == spell_id)
+			return &rule;
+	}
+	return nullptr;
+}
+
+// Called after a buff window refresh. Only reschedules slots whose spell changed or that were refreshed (ticks went up).
+void BuffAlert_OnBuffsRefreshed(bool song_buffs, int num_slots)
+{
+	if (BuffAlertRules.empty())
+		return;
+
+	_EQBUFFINFO* buffs = GetStartBuffArray(song_buffs);
+	for (int i = 0; i < num_slots; i++)
+	{
+		EQBUFFINFO& buff = buffs[i];
+		BuffAlertSlot& slot = BuffAlertSlots[i + (song_buffs ? EQ_NUM_BUFFS : 0)];
+		WORD spell_id = buff.BuffType ? buff.SpellId : EQ_SPELL_ID_NULL;
+		bool changed = spell_id != slot.spell_id || buff.Ticks > slot.ticks;
+		slot.ticks = buff.Ticks;
+		if (!changed)
+			continue;
+
+		slot.spell_id = spell_id;
+		slot.generation++; // Anything already queued for this slot is now stale
+
+		const BuffAlertRule* rule = BuffAlert_FindRule(spell_id);
+		if (!rule || buff.Ticks == 0)
+			continue;
+		int remaining_ms = BuffCountdown_GetRemainingMs(song_buffs, i);
+		int lead_ms = rule->lead_seconds * 1000;
+		if (remaining_ms <= lead_ms) // Landed with less time than the warning, nothing to warn about
+			continue;
+		BuffAlertQueue.push({ EqGetTime() + remaining_ms - lead_ms, i + (song_buffs ? EQ_NUM_BUFFS : 0), slot.generation });
+	}
+}
+
+void BuffAlert_Fire(const BuffAlertRule& rule)
+{
+	EQSPELLINFO* spell = EQ_Spell::GetSpell(rule.spell_id);
+	const char* name = spell ? spell->Name : "Unknown";
+	switch (rule.kind)
+	{
+	case BuffAlert_Chat:
+		print_chat("%s will fade in %d seconds.", name, rule.lead_seconds);
+		break;
+	case BuffAlert_Sound:
+		MessageBeep(MB_ICONEXCLAMATION);
+		break;
+	case BuffAlert_Flash:
+	{
+		HWND hwnd = *(HWND*)EQ_WINDOW_HWND;
+		if (hwnd && GetForegroundWindow() != hwnd)
+		{
+			FLASHWINFO info = { sizeof(FLASHWINFO), hwnd, FLASHW_ALL | FLASHW_TIMERNOFG, 0, 0 };
+			FlashWindowEx(&info);
+		}
+		break;
+	}
+	}
+}
+
+// Runs every frame. Usually just a peek at the top of the queue.
+void BuffAlert_Pulse()
+{
+	if (BuffAlertQueue.empty())
+		return;
+	__int64 now = EqGetTime();
+	while (!BuffAlertQueue.empty() && BuffAlertQueue.top().fire_time <= now)
+	{
+		BuffAlertEvent event = BuffAlertQueue.top();
+		BuffAlertQueue.pop();
+		BuffAlertSlot& slot = BuffAlertSlots[event.slot];
+		if (event.generation != slot.generation)
+			continue; // Slot changed since this was scheduled
+		const BuffAlertRule* rule = BuffAlert_FindRule(slot.spell_id);
+		if (rule)
+			BuffAlert_Fire(*rule);
+	}
+}
+
+void BuffAlert_Reset()
+{
+	BuffAlertQueue = {};
+	memset(BuffAlertSlots, 0, sizeof(BuffAlertSlots));
+	for (auto& slot : BuffAlertSlots)
+		slot.spell_id = EQ_SPELL_ID_NULL;
+}
+
+// Format: "spell_id:seconds:kind,spell_id:seconds:kind,..."
+void BuffAlert_SaveRules()
+{
+	std::string value;
+	for (auto& rule : BuffAlertRules) {
+		char entry[32];
+		_snprintf_s(entry, sizeof(entry), _TRUNCATE, "%s%u:%d:%d", value.empty() ? "" : ",", rule.spell_id, rule.lead_seconds, rule.kind);
+		value += entry;
+	}
+	WritePrivateProfileStringA("Defaults", "BuffAlerts", value.c_str(), "./eqclient.ini");
+}
+
+void BuffAlert_LoadRules(const char* value)
+{
+	BuffAlertRules.clear();
+	const char* p = value;
+	while (*p) {
+		unsigned int spell_id = 0;
+		int lead_seconds = 0;
+		int kind = 0;
+		if (sscanf_s(p, "%u:%d:%d", &spell_id, &lead_seconds, &kind) == 3
+			&& spell_id < EQ_NUM_SPELLS && lead_seconds > 0 && kind >= BuffAlert_Chat && kind <= BuffAlert_Flash)
+		{
+			BuffAlertRules.push_back({ (WORD)spell_id, lead_seconds < BUFF_ALERT_MAX_LEAD_SECONDS ? lead_seconds : BUFF_ALERT_MAX_LEAD_SECONDS, (BuffAlertKind)kind });
+		}
+		p = strchr(p, ',');
+		if (!p)
+			break;
+		p++;
+	}
+}
+
+// /buffalert                                   - Lists alerts
+// /buffalert clear                             - Removes all alerts
+// /buffalert <seconds> <chat|sound|flash> <spell name|#id> - Adds (or replaces) an alert, 0 seconds removes it
+void BuffAlert_HandleCommand(const char* args)
+{
+	while (*args == ' ')
+		args++;
+
+	if (*args == '\0') {
+		if (BuffAlertRules.empty())
+			print_chat("No buff alerts. Usage: /buffalert <seconds> <chat|sound|flash> <spell name|#id>");
+		for (auto& rule : BuffAlertRules) {
+			EQSPELLINFO* spell = EQ_Spell::GetSpell(rule.spell_id);
+			print_chat("Buff alert: %s at %d seconds (%s).", spell ? spell->Name : "Unknown", rule.lead_seconds, BuffAlertKindNames[rule.kind]);
+		}
+		return;
+	}
+	if (_stricmp(args, "clear") == 0) {
+		BuffAlertRules.clear();
+		BuffAlert_SaveRules();
+		print_chat("Buff alerts cleared.");
+		return;
+	}
+
+	int lead_seconds = 0;
+	char kind_name[16] = { 0 };
+	int consumed = 0;
+	if (sscanf_s(args, "%d %15s %n", &lead_seconds, kind_name, (unsigned)sizeof(kind_name), &consumed) < 2 || consumed == 0 || lead_seconds < 0) {
+		print_chat("Usage: /buffalert <seconds> <chat|sound|flash> <spell name|#id>");
+		return;
+	}
+	if (lead_seconds > BUFF_ALERT_MAX_LEAD_SECONDS)
+		lead_seconds = BUFF_ALERT_MAX_LEAD_SECONDS; // Also keeps lead_seconds * 1000 in range
+	int kind = -1;
+	for (int i = 0; i < 3; i++) {
+		if (_stricmp(kind_name, BuffAlertKindNames[i]) == 0)
+			kind = i;
+	}
+	const char* spell_arg = args + consumed;
+	// Ids need an explicit '#', so spell names that start with a digit still work
+	int spell_id = -1;
+	if (*spell_arg == '#') {
+		char* end = nullptr;
+		long id = strtol(spell_arg + 1, &end, 10);
+		if (end != spell_arg + 1 && *end == '\0' && id >= 0 && id < EQ_NUM_SPELLS)
+			spell_id = (int)id;
+	}
+	else {
+		spell_id = EQ_GetSpellIdBySpellName(spell_arg);
+	}
+	if (kind < 0 || spell_id < 0 || spell_id >= EQ_NUM_SPELLS || !EQ_Spell::IsValidSpellIndex(spell_id)) {
+		print_chat("Usage: /buffalert <seconds> <chat|sound|flash> <spell name|#id>");
+		return;
+	}
+
+	BuffAlertRules.erase(std::remove_if(BuffAlertRules.begin(), BuffAlertRules.end(),
+		[spell_id](const BuffAlertRule& rule) { return rule.spell_id == spell_id; }), BuffAlertRules.end());
+	EQSPELLINFO* spell = EQ_Spell::GetSpell(spell_id);
+	if (lead_seconds == 0) {
+		print_chat("Buff alert removed: %s.", spell->Name);
+	}
+	else {
+		BuffAlertRules.push_back({ (WORD)spell_id, lead_seconds, (BuffAlertKind)kind });
+		print_chat("Buff alert: %s at %d seconds (%s).", spell->Name, lead_seconds, BuffAlertKindNames[kind]);
+	}
+	BuffAlert_SaveRules();
+	BuffAlert_Reset(); // Reschedules everything on the next refresh
+}
+
+// ---------- Song label cache ----------
+// Labels are queried every frame, but a song slot only changes a few times a minute. Each label id (EqType) remembers
+// what it last wrote and what for (spell id, or spell id + seconds left for timers), and skips the spell lookups and the
+// CXStr_Set (which reallocates) while the key is unchanged and the CXStr it is asked to fill still holds that text.
+// Comparing the contents (not the CXStr pointer) stays correct if the client frees, reuses or rewrites the string.
+struct SongLabelCacheEntry {
+	unsigned __int64 key;
+	bool valid;
+	char text[64]; // Longer text is never treated as current, so it's just rewritten every time
+};
+SongLabelCacheEntry SongNameLabelCache[EQ_NUM_BUFFS];
+SongLabelCacheEntry SongTimerLabelCache[EQ_NUM_BUFFS];
+
+bool SongLabelCache_IsCurrent(SongLabelCacheEntry& entry, PEQCXSTR* str, unsigned __int64 key) {
+	if (!entry.valid || entry.key != key || !*str)
+		return false;
+	PEQCXSTR cxstr = *str;
+	return cxstr->Encoding == 0 && cxstr->Length < sizeof(entry.text) && memcmp(cxstr->Text, entry.text, cxstr->Length + 1) == 0;
+}
+void SongLabelCache_Set(SongLabelCacheEntry& entry, PEQCXSTR* str, unsigned __int64 key, PCHAR text) {
+	EQ_CXStr_Set(str, text);
+	size_t length = strlen(text);
+	entry.key = key;
+	entry.valid = length < sizeof(entry.text);
+	if (entry.valid)
+		memcpy(entry.text, text, length + 1);
+}
+void SongLabelCache_Clear() {
+	memset(SongNameLabelCache, 0, sizeof(SongNameLabelCache));
+	memset(SongTimerLabelCache, 0, sizeof(SongTimerLabelCache));
+}
+
+// The client's own label ids stop below 135, where the song name labels start, so 150-164 are unused by it as well.
+// The first query of each timer id still goes to the client, and an id it answers stays the client's.
+enum SongTimerLabelOwner : BYTE {
+	SongTimerLabelOwner_Unchecked,
+	SongTimerLabelOwner_Dll,
+	SongTimerLabelOwner_Client,
+};
+SongTimerLabelOwner SongTimerLabelOwners[EQ_NUM_BUFFS];
+
 typedef bool(__cdecl* EQ_FUNCTION_TYPE_GetLabelFromEQ)(int, PEQCXSTR*, bool*, DWORD*);
 EQ_FUNCTION_TYPE_GetLabelFromEQ GetLabelFromEQ_Trampoline;
 bool __cdecl GetLabelFromEQ_Detour(int EqType, PEQCXSTR* str, bool* override_color, DWORD* color)
 {
+	HOOK_TIMER(HookId_GetLabelFromEQ);
 	switch (EqType) {
 	case 135: // Song1
 	case 136: // Song2
@@ -227,26 +1196,191 @@ bool __cdecl GetLabelFromEQ_Detour(int EqType, PEQCXSTR* str, bool* override_col
 	case 147: // Song13
 	case 148: // Song14
 	case 149: // Song15
+	{
 		*override_color = false;
-		if (EQ_OBJECT_CharInfo) {
-			EQBUFFINFO& buff = EQ_OBJECT_CharInfo->BuffsExt[EqType - 135];
-			if (EQ_Spell::IsValidSpellIndex(buff.SpellId)) {
-				EQSPELLINFO* spell = EQ_Spell::GetSpell(buff.SpellId);
-				if (spell) {
-					EQ_CXStr_Set(str, spell->Name);
-					return true;
-				}
+		SongLabelCacheEntry& entry = SongNameLabelCache[EqType - 135];
+		if (!EQ_OBJECT_CharInfo) {
+			entry.valid = false;
+			EQ_CXStr_Set(str, "");
+			return true;
+		}
+		WORD spell_id = EQ_OBJECT_CharInfo->BuffsExt[EqType - 135].SpellId;
+		if (SongLabelCache_IsCurrent(entry, str, spell_id))
+			return true;
+		if (EQ_Spell::IsValidSpellIndex(spell_id)) {
+			EQSPELLINFO* spell = EQ_Spell::GetSpell(spell_id);
+			if (spell) {
+				SongLabelCache_Set(entry, str, spell_id, spell->Name);
+				return true;
 			}
 		}
-		EQ_CXStr_Set(str, "");
+		SongLabelCache_Set(entry, str, spell_id, "");
 		return true;
 	}
+	case 150: // Song1Timer
+	case 151: // Song2Timer
+	case 152: // Song3Timer
+	case 153: // Song4Timer
+	case 154: // Song5Timer
+	case 155: // Song6Timer
+	case 156: // Song7Timer
+	case 157: // Song8Timer
+	case 158: // Song9Timer
+	case 159: // Song10Timer
+	case 160: // Song11Timer
+	case 161: // Song12Timer
+	case 162: // Song13Timer
+	case 163: // Song14Timer
+	case 164: // Song15Timer
+	{
+		// Remaining time for a song slot, for skins that want timers without the PostDraw overlay
+		SongTimerLabelOwner& owner = SongTimerLabelOwners[EqType - 150];
+		if (owner == SongTimerLabelOwner_Client)
+			return GetLabelFromEQ_Trampoline(EqType, str, override_color, color);
+		if (owner == SongTimerLabelOwner_Unchecked) {
+			if (GetLabelFromEQ_Trampoline(EqType, str, override_color, color)) {
+				owner = SongTimerLabelOwner_Client;
+				return true;
+			}
+			owner = SongTimerLabelOwner_Dll;
+		}
+		*override_color = false;
+		SongLabelCacheEntry& entry = SongTimerLabelCache[EqType - 150];
+		if (!EQ_OBJECT_CharInfo) {
+			entry.valid = false;
+			EQ_CXStr_Set(str, "");
+			return true;
+		}
+		EQBUFFINFO& buff = EQ_OBJECT_CharInfo->BuffsExt[EqType - 150];
+		int remaining_ms = BuffCountdown_GetRemainingMs(true, EqType - 150);
+		unsigned __int64 key = ((unsigned __int64)buff.SpellId << 32) | (DWORD)((remaining_ms + 999) / 1000);
+		if (SongLabelCache_IsCurrent(entry, str, key))
+			return true;
+		if (buff.BuffType != 0 && remaining_ms > 0 && EQ_Spell::IsValidSpellIndex(buff.SpellId)) {
+			char buffTimeText[128];
+			BuffCountdown_GetShortTimeString(remaining_ms, buffTimeText, sizeof(buffTimeText));
+			SongLabelCache_Set(entry, str, key, buffTimeText);
+			return true;
+		}
+		SongLabelCache_Set(entry, str, key, "");
+		return true;
+	}
+	}
 	return GetLabelFromEQ_Trampoline(EqType, str, override_color, color);
 }
 
+// ---------- Song Window auto-hide ----------
+// Visibility is re-evaluated on every refresh (and when the settings change), but Show() is only called once a pending
+// transition has outlasted its delay. With a hide delay set, a short gap while twisting cancels the pending hide instead
+// of hiding and re-showing (and re-laying out) the window. Both delays default to 0, which behaves like the old
+// immediate show/hide.
+enum SongWindowVisibilityState {
+	SongWindowVisibility_Hidden,
+	SongWindowVisibility_PendingShow,
+	SongWindowVisibility_Shown,
+	SongWindowVisibility_PendingHide,
+};
+SongWindowVisibilityState SongWindowVisibility = SongWindowVisibility_Hidden;
+__int64 SongWindowVisibility_Deadline = 0;
+int SongWindowVisibility_HasSongs = -1; // -1 = unknown (no refresh since the window was created)
+
+bool SongWindow_ShouldAutoHide() {
+	return g_bSongWindowAutoHide || Rule_Num_Short_Buffs == 0;
+}
+
+// Moves straight to a settled state, calling Show() only if the window isn't already there.
+void SongWindowVisibility_Apply(bool visible) {
+	if (!SongWindow_HooksInstalled)
+		visible = false;
+	SongWindowVisibility = visible ? SongWindowVisibility_Shown : SongWindowVisibility_Hidden;
+	CShortBuffWindow* wnd = GetShortDurationBuffWindow();
+	if (wnd && wnd->IsVisibile() != visible)
+		wnd->Show(visible ? 1 : 0, 1);
+}
+
+void SongWindowVisibility_Request(bool visible) {
+	SongWindowVisibilityState settled = visible ? SongWindowVisibility_Shown : SongWindowVisibility_Hidden;
+	SongWindowVisibilityState pending = visible ? SongWindowVisibility_PendingShow : SongWindowVisibility_PendingHide;
+	SongWindowVisibilityState cancel = visible ? SongWindowVisibility_PendingHide : SongWindowVisibility_PendingShow;
+
+	if (SongWindowVisibility == settled || SongWindowVisibility == pending)
+		return;
+	if (SongWindowVisibility == cancel) { // Flipped back before the delay ran out, nothing to do on screen
+		SongWindowVisibility = settled;
+		return;
+	}
+	int delay = visible ? g_songWindowShowDelayMs : g_songWindowHideDelayMs;
+	if (delay <= 0) {
+		SongWindowVisibility_Apply(visible);
+		return;
+	}
+	SongWindowVisibility = pending;
+	SongWindowVisibility_Deadline = EqGetTime() + delay;
+}
+
+// Drops any pending transition, leaving the window as it is.
+void SongWindowVisibility_Cancel() {
+	if (SongWindowVisibility == SongWindowVisibility_PendingShow)
+		SongWindowVisibility = SongWindowVisibility_Hidden;
+	else if (SongWindowVisibility == SongWindowVisibility_PendingHide)
+		SongWindowVisibility = SongWindowVisibility_Shown;
+}
+
+// Picks up Show() calls made outside the state machine (UI reload, user closing the window, etc)
+void SongWindowVisibility_Sync() {
+	CShortBuffWindow* wnd = GetShortDurationBuffWindow();
+	if (!wnd)
+		return;
+	if (SongWindowVisibility == SongWindowVisibility_Shown || SongWindowVisibility == SongWindowVisibility_Hidden)
+		SongWindowVisibility = wnd->IsVisibile() ? SongWindowVisibility_Shown : SongWindowVisibility_Hidden;
+}
+
+void SongWindowVisibility_Evaluate() {
+	SongWindowVisibility_Sync();
+	if (SongWindowVisibility_HasSongs > 0)
+		SongWindowVisibility_Request(true);
+	else if (SongWindowVisibility_HasSongs == 0 && SongWindow_ShouldAutoHide())
+		SongWindowVisibility_Request(false);
+	else
+		SongWindowVisibility_Cancel();
+}
+
+// Event - Called by every refresh of the song window. Re-checks the window each time, so a window the user closed while
+// songs are up is shown again like before; Show() itself is still only called on a real transition.
+void SongWindowVisibility_OnRefresh(bool has_songs) {
+	SongWindowVisibility_HasSongs = has_songs;
+	SongWindowVisibility_Evaluate();
+}
+
+// Event - Auto-hide was toggled.
+void SongWindowVisibility_OnSettingsChanged() {
+	SongWindowVisibility_Sync();
+	if (!SongWindow_ShouldAutoHide()) {
+		SongWindowVisibility_Apply(true);
+		return;
+	}
+	SongWindowVisibility_Evaluate();
+}
+
+// Event - The song window was (re)created or (re)activated, so what we know about it is stale.
+void SongWindowVisibility_Reset() {
+	SongWindowVisibility_HasSongs = -1;
+	SongWindowVisibility = SongWindowVisibility_Hidden;
+	SongWindowVisibility_Sync();
+}
+
+// Runs every frame. Applies a pending transition once its delay is up.
+void SongWindowVisibility_Pulse() {
+	if (SongWindowVisibility != SongWindowVisibility_PendingShow && SongWindowVisibility != SongWindowVisibility_PendingHide)
+		return;
+	if (EqGetTime() < SongWindowVisibility_Deadline)
+		return;
+	SongWindowVisibility_Apply(SongWindowVisibility == SongWindowVisibility_PendingShow);
+}
 
 void __fastcall EQMACMQ_DETOUR_CBuffWindow__RefreshBuffDisplay(CBuffWindow* this_ptr, void* not_used)
 {
+	HOOK_TIMER(HookId_RefreshBuffDisplay);
 	PEQCBUFFWINDOW buffWindow = (PEQCBUFFWINDOW)this_ptr;
 	PEQCHARINFO charInfo = (PEQCHARINFO)EQ_OBJECT_CharInfo;
 
@@ -257,16 +1391,26 @@ void __fastcall EQMACMQ_DETOUR_CBuffWindow__RefreshBuffDisplay(CBuffWindow* this
 
 	// Supports ShortBuffWindow(Songs) and BuffWindow, which use different buff offsets
 	bool is_song_window = (this_ptr == GetShortDurationBuffWindow());
+	if (is_song_window && !SongWindow_HooksInstalled)
+	{
+		// No handshake yet, so GetBuff isn't redirected and the client would show main buffs here
+		if (this_ptr->IsVisibile())
+			this_ptr->Show(0, 1);
+		return;
+	}
 	_EQBUFFINFO* buffs = GetStartBuffArray(is_song_window);
+	BuffCountdown_Update(is_song_window); // The slots may have changed since this frame's pulse
 
-	MakeGetBuffReturnSongs(is_song_window);
-	EQMACMQ_REAL_CBuffWindow__RefreshBuffDisplay(this_ptr);
-	MakeGetBuffReturnSongs(false);
+	{
+		ScopedBuffView view(this_ptr, is_song_window);
+		EQMACMQ_REAL_CBuffWindow__RefreshBuffDisplay(this_ptr);
+	}
 
 	int num_buffs = 0;
+	int num_slots = GetBuffWindowSlotCount(is_song_window);
 
 	// -- Standard Dll Support Buff Text / Timer --
-	for (size_t i = 0; i < EQ_NUM_BUFFS; i++)
+	for (int i = 0; i < num_slots; i++)
 	{
 		EQBUFFINFO& buff = buffs[i];
 		if (!EQ_Spell::IsValidSpellIndex(buff.SpellId) || buff.BuffType == 0)
@@ -296,24 +1440,18 @@ void __fastcall EQMACMQ_DETOUR_CBuffWindow__RefreshBuffDisplay(CBuffWindow* this
 		}
 	}
 
+	BuffAlert_OnBuffsRefreshed(is_song_window, num_slots);
+
 	if (is_song_window)
 	{
-		if (this_ptr->IsVisibile())
-		{
-			if (num_buffs == 0 && (g_bSongWindowAutoHide || Rule_Num_Short_Buffs == 0)) // Visible, but support is disabled or auto-hide
-				this_ptr->Show(0, 1);
-			return;
-		}
-		if (num_buffs > 0)
-		{
-			// Not visible and we have buffs. Show.
-			this_ptr->Show(1, 1);
-		}
+		// Shows when we have songs, hides when empty and support is disabled or auto-hide is on (see SongWindowVisibility)
+		SongWindowVisibility_OnRefresh(num_buffs > 0);
 	}
 }
 
 int __fastcall EQMACMQ_DETOUR_CBuffWindow__PostDraw(CBuffWindow* this_ptr, void* not_used)
 {
+	HOOK_TIMER(HookId_PostDraw);
 
 	int result = EQMACMQ_REAL_CBuffWindow__PostDraw(this_ptr);
 	PEQCBUFFWINDOW buffWindow = (PEQCBUFFWINDOW)this_ptr;
@@ -324,9 +1462,14 @@ int __fastcall EQMACMQ_DETOUR_CBuffWindow__PostDraw(CBuffWindow* this_ptr, void*
 	}
 
 	bool is_song_window = (this_ptr == GetShortDurationBuffWindow());
+	if (is_song_window && !SongWindow_HooksInstalled)
+	{
+		return result;
+	}
 	_EQBUFFINFO* buffs = GetStartBuffArray(is_song_window); // Song Window Support
+	int num_slots = GetBuffWindowSlotCount(is_song_window);
 
-	for (size_t i = 0; i < EQ_NUM_BUFFS; i++)
+	for (int i = 0; i < num_slots; i++)
 	{
 		EQBUFFINFO& buff = buffs[i];
 
@@ -335,13 +1478,13 @@ int __fastcall EQMACMQ_DETOUR_CBuffWindow__PostDraw(CBuffWindow* this_ptr, void*
 			continue;
 		}
 
-		int buffTicks = buff.Ticks;
-		if (buffTicks == 0)
+		int remainingMs = BuffCountdown_GetRemainingMs(is_song_window, i); // Counts down every second between server ticks
+		if (remainingMs == 0)
 		{
 			continue;
 		}
 		char buffTimeText[128];
-		EQ_GetShortTickTimeString(buffTicks, buffTimeText, sizeof(buffTimeText));
+		BuffCountdown_GetShortTimeString(remainingMs, buffTimeText, sizeof(buffTimeText));
 
 		PEQCBUFFBUTTONWND buffButtonWnd = buffWindow->BuffButtonWnd[i];
 
@@ -367,14 +1510,16 @@ int __fastcall EQMACMQ_DETOUR_CBuffWindow__PostDraw(CBuffWindow* this_ptr, void*
 	return result;
 }
 
-// ---- CEverQuest::InterpretCmd detour (ONLY adds /songs) ----
+// ---- CEverQuest::InterpretCmd detour (adds /songs, /buffalert, /getbuff, /hookstats, /trace, /sigdump) ----
 struct EQPlayer; // forward
+void GetBuffHook_HandleCommand(const char* args);
 
 typedef int(__thiscall* EQ_FUNCTION_TYPE_CEverQuest__InterpretCmd)(void* this_ptr, EQPlayer* a1, char* a2);
 EQ_FUNCTION_TYPE_CEverQuest__InterpretCmd EQMACMQ_REAL_CEverQuest__InterpretCmd = nullptr;
 
 int __fastcall EQMACMQ_DETOUR_CEverQuest__InterpretCmd(void* this_ptr, void* /*not_used*/, EQPlayer* a1, char* a2)
 {
+	HOOK_TIMER(HookId_InterpretCmd);
 	if (!a2) {
 		return EQMACMQ_REAL_CEverQuest__InterpretCmd(this_ptr, a1, a2);
 	}
@@ -403,13 +1548,34 @@ int __fastcall EQMACMQ_DETOUR_CEverQuest__InterpretCmd(void* this_ptr, void* /*n
 		// Feedback
 		print_chat("Song Window auto-hide: %s.", g_bSongWindowAutoHide ? "ON" : "OFF");
 
-		// If we just turned auto-hide OFF, and the window is hidden, show it now
-		if (!g_bSongWindowAutoHide && GetShortDurationBuffWindow() &&
-			!GetShortDurationBuffWindow()->IsVisibile())
-		{
-			GetShortDurationBuffWindow()->Show(1, 1);
-		}
+		// If we just turned auto-hide OFF, and the window is hidden, show it now (or start hiding it if turned ON)
+		SongWindowVisibility_OnSettingsChanged();
+
+		return 0; // handled
+	}
+
+	if (strncmp(a2, "/hookstats", 10) == 0 && (a2[10] == '\0' || a2[10] == ' ')) {
+		HookStats_HandleCommand(a2 + 10);
+		return 0; // handled
+	}
+
+	if (strcmp(a2, "/sigdump") == 0) {
+		AddressResolver_HandleSigDump();
+		return 0; // handled
+	}
 
+	if (strncmp(a2, "/trace", 6) == 0 && (a2[6] == '\0' || a2[6] == ' ')) {
+		Trace_HandleCommand(a2 + 6);
+		return 0; // handled
+	}
+
+	if (strncmp(a2, "/getbuff", 8) == 0 && (a2[8] == '\0' || a2[8] == ' ')) {
+		GetBuffHook_HandleCommand(a2 + 8);
+		return 0; // handled
+	}
+
+	if (strncmp(a2, "/buffalert", 10) == 0 && (a2[10] == '\0' || a2[10] == ' ')) {
+		BuffAlert_HandleCommand(a2 + 10);
 		return 0; // handled
 	}
 
@@ -511,16 +1677,42 @@ constexpr WORD BSP_VERSION_1 = 1; // Buff Stacking feature flag sent to the serv
 
 // Short Buff Window
 CShortBuffWindow* ShortBuffWindow = nullptr;
-// Set during ShortBuffWindow's refresh logic, so it reads from offset 15 (because it shares logic with CBuffWindow)
-thread_local bool ShortBuffSupport_ReturnSongBuffs = false;
+
+// Compact mode: The song window only shows as many buttons as the server gave us song slots (Rule_Num_Short_Buffs).
+// The rest are hidden so they aren't drawn, and our refresh/PostDraw/WndNotification loops stop at GetBuffWindowSlotCount().
+// This is layout and loop work only, not memory: the buttons are SIDL children built from the UI skin's screen definition
+// when the window is constructed (before the handshake tells us the slot count), and the client's own CBuffWindow
+// refresh/draw code walks all EQ_NUM_BUFFS entries of BuffButtonWnd, so they have to stay allocated.
+void ShortBuffWindow_ApplyCompactLayout()
+{
+	if (!ShortBuffWindow)
+		return;
+	PEQCBUFFWINDOW buffWindow = (PEQCBUFFWINDOW)ShortBuffWindow;
+	int num_slots = GetBuffWindowSlotCount(true);
+	for (int i = 0; i < EQ_NUM_BUFFS; i++)
+	{
+		CXWnd* button = (CXWnd*)buffWindow->BuffButtonWnd[i];
+		if (button)
+			button->Show(i < num_slots ? 1 : 0, 0);
+	}
+}
 
 // -- [Handshake / Initialization] --
 
+// Hooks are only installed once the handshake turns the feature on (see [Lazy Hooks] below)
+void BuffstackingPatch_SetHooksInstalled(bool install);
+void SongWindow_SetHooksInstalled(bool install);
+bool BuffstackingPatch_Available();
+bool SongWindow_Available();
+
 void BuffstackingPatch_OnZone()
 {
 	// Send handshake message to enable the client/server buffstacking changes.
-	bool is_new_ui = *(BYTE*)0x8092D8 != 0;
-	if (is_new_ui)
+	// Nothing is offered that we couldn't hook on this exe (see the address resolver).
+	if (!BuffstackingPatch_Available())
+		return;
+	bool is_new_ui = Address(Address_NewUIFlag) && *(BYTE*)Address(Address_NewUIFlag) != 0;
+	if (is_new_ui && SongWindow_Available())
 		SendCustomSpawnAppearanceMessage(CustomSpawnAppearanceMessage_BuffStackingPatchWithSongWindowHandshake, BSP_VERSION_1, true);
 	else
 		SendCustomSpawnAppearanceMessage(CustomSpawnAppearanceMessage_BuffStackingPatchWithoutSongWindowHandshake, BSP_VERSION_1, true);
@@ -536,7 +1728,7 @@ bool BuffstackingPatch_HandleHandshake(DWORD id, DWORD value, bool is_request)
 
 	if (id == CustomSpawnAppearanceMessage_BuffStackingPatchWithSongWindowHandshake)
 	{
-		if (value == BSP_VERSION_1)
+		if (value == BSP_VERSION_1 && BuffstackingPatch_Available() && SongWindow_Available())
 		{
 			enabled = true;
 			enabled_songs = 6;
@@ -548,7 +1740,7 @@ bool BuffstackingPatch_HandleHandshake(DWORD id, DWORD value, bool is_request)
 	}
 	else if (id == CustomSpawnAppearanceMessage_BuffStackingPatchWithoutSongWindowHandshake)
 	{
-		if (value == BSP_VERSION_1)
+		if (value == BSP_VERSION_1 && BuffstackingPatch_Available())
 		{
 			enabled = true;
 			enabled_songs = 0;
@@ -567,6 +1759,10 @@ bool BuffstackingPatch_HandleHandshake(DWORD id, DWORD value, bool is_request)
 	Rule_Buffstacking_Patch_Enabled = enabled;
 	Rule_Max_Buffs = EQ_NUM_BUFFS + enabled_songs;
 	Rule_Num_Short_Buffs = enabled_songs;
+	BuffstackingPatch_SetHooksInstalled(enabled);
+	SongWindow_SetHooksInstalled(enabled_songs > 0);
+	SongWindowVisibility_Reset(); // Re-evaluated on the next refresh
+	ShortBuffWindow_ApplyCompactLayout();
 	if (send_response)
 	{
 		SendCustomSpawnAppearanceMessage(id, value, false);
@@ -998,6 +2194,7 @@ RETURN_RESULT_SLOTNUM_194:
 typedef _EQBUFFINFO* (__thiscall* EQ_FUNCTION_TYPE_EQCharacter__FindAffectSlot)(EQCHARINFO* this_ptr, WORD spellid, _EQSPAWNINFO* caster, DWORD* out_slot, int flag);
 EQ_FUNCTION_TYPE_EQCharacter__FindAffectSlot EQCharacter__FindAffectSlot_Trampoline;
 _EQBUFFINFO* __fastcall EQCharacter__FindAffectSlot_Detour(EQCHARINFO* player, int unused, WORD spellid, _EQSPAWNINFO* caster, DWORD* out_slot, int flag) {
+	HOOK_TIMER(HookId_FindAffectSlot);
 	if (Rule_Buffstacking_Patch_Enabled) {
 		return BSP_FindAffectSlot(player, spellid, caster, out_slot, flag);
 	}
@@ -1011,8 +2208,13 @@ _EQBUFFINFO* __fastcall EQCharacter__FindAffectSlot_Detour(EQCHARINFO* player, i
 _EQBUFFINFO* GetStartBuffArray(bool song_buffs) {
 	return song_buffs ? EQ_OBJECT_CharInfo->BuffsExt : EQ_OBJECT_CharInfo->Buff;
 }
-void MakeGetBuffReturnSongs(bool enabled) {
-	ShortBuffSupport_ReturnSongBuffs = enabled;
+// Number of slots (and buttons) in use. Songs only ever land in the first Rule_Num_Short_Buffs of BuffsExt.
+int GetBuffWindowSlotCount(bool song_buffs) {
+	if (!song_buffs)
+		return EQ_NUM_BUFFS;
+	if (Rule_Num_Short_Buffs <= 0)
+		return 0;
+	return Rule_Num_Short_Buffs < EQ_NUM_BUFFS ? Rule_Num_Short_Buffs : EQ_NUM_BUFFS;
 }
 
 // MaxBuffs is now increased when enabled (Rule_Max_Buffs)
@@ -1036,13 +2238,66 @@ int __fastcall EQCHARACTER__GetMaxBuffs_Detour(EQCHARINFO* player, int unused)
 typedef _EQBUFFINFO* (__thiscall* EQ_FUNCTION_TYPE_EQCharacter__GetBuff)(EQCHARINFO* this_char_info, int buff_slot);
 EQ_FUNCTION_TYPE_EQCharacter__GetBuff EQCharacter__GetBuff_Trampoline;
 _EQBUFFINFO* __fastcall EQCharacter__GetBuff_Detour(EQCHARINFO* player, int unused, WORD buff_slot) {
-	if (ShortBuffSupport_ReturnSongBuffs && buff_slot < 15) {
+	HOOK_TIMER(HookId_GetBuff);
+	if (CurrentBuffView.song_buffs && buff_slot < 15) {
 		buff_slot += 15;
 	}
 	return EQCharacter__GetBuff_Trampoline(player, buff_slot);
 }
 
+// Inline replacement for EQCharacter::GetBuff (selected with /getbuff inline). The game's version is just an index into
+// Buff[] for slots 0-14, and into BuffsExtMinus15[] (so BuffsExt starts at slot 15) after that. Jumping straight here
+// from 0x004C465A skips the Detours jump, the trampoline and the stolen instructions of the detour above.
+_EQBUFFINFO* __fastcall EQCharacter__GetBuff_Inline(EQCHARINFO* player, int unused, WORD buff_slot) {
+	HOOK_TIMER(HookId_GetBuff);
+	if (buff_slot < EQ_NUM_BUFFS) {
+		if (CurrentBuffView.song_buffs)
+			return &player->BuffsExt[buff_slot];
+		return &player->Buff[buff_slot];
+	}
+	return player->BuffsExtMinus15 + buff_slot;
+}
+
+enum GetBuffHookMode {
+	GetBuffHookMode_None,
+	GetBuffHookMode_Detour,
+	GetBuffHookMode_Inline,
+};
+GetBuffHookMode GetBuffHook_Installed = GetBuffHookMode_None;
+bool g_bGetBuffInline = false; // /getbuff <detour|inline>, eqclient.ini [Defaults] GetBuffInline
+PatchTransaction GetBuffHook_InlinePatch;
+
+void EQCharacter__GetBuff_SetHook(GetBuffHookMode mode)
+{
+	if (mode == GetBuffHook_Installed)
+		return;
+
+	// Take out whatever is there first
+	if (GetBuffHook_Installed == GetBuffHookMode_Detour)
+		DetourRemove((PBYTE)EQCharacter__GetBuff_Trampoline, (PBYTE)EQCharacter__GetBuff_Detour);
+	else if (GetBuffHook_Installed == GetBuffHookMode_Inline)
+		GetBuffHook_InlinePatch.Rollback();
+	GetBuffHook_Installed = GetBuffHookMode_None;
+
+	if (mode == GetBuffHookMode_Detour) {
+		EQCharacter__GetBuff_Trampoline = (EQ_FUNCTION_TYPE_EQCharacter__GetBuff)DetourAddress(Address_GetBuff, (PBYTE)EQCharacter__GetBuff_Detour); // Supports reading buffs 16-30 in Song Window
+		if (EQCharacter__GetBuff_Trampoline)
+			GetBuffHook_Installed = GetBuffHookMode_Detour;
+	}
+	else if (mode == GetBuffHookMode_Inline && Address(Address_GetBuff)) {
+		// 'jmp EQCharacter__GetBuff_Inline' over the start of GetBuff, the original is never called
+		BYTE jmp_inst[5] = { 0xE9 };
+		*(uintptr_t*)&jmp_inst[1] = (uintptr_t)EQCharacter__GetBuff_Inline - (Address(Address_GetBuff) + 5);
+		GetBuffHook_InlinePatch = PatchTransaction();
+		GetBuffHook_InlinePatch.Write(Address(Address_GetBuff), jmp_inst, sizeof(jmp_inst));
+		if (GetBuffHook_InlinePatch.Commit())
+			GetBuffHook_Installed = GetBuffHookMode_Inline;
+	}
+}
+
 // Hook that removes buffs or shows spell info when clicking the song window, and shows tooltips on mouseover
+typedef int(__thiscall* EQ_FUNCTION_TYPE_CBuffWindow__WndNotification)(CBuffWindow* this_ptr, PEQCBUFFBUTTONWND sender, int type, int a4);
+EQ_FUNCTION_TYPE_CBuffWindow__WndNotification CBuffWindow__WndNotification_Trampoline;
 int __fastcall CBuffWindow__WndNotification_Detour(CBuffWindow* self, int unused, PEQCBUFFBUTTONWND sender, int type, int a4)
 {
 	// Shared hook with CBuffWindow
@@ -1055,14 +2310,16 @@ int __fastcall CBuffWindow__WndNotification_Detour(CBuffWindow* self, int unused
 		if (type != 23 && type != 25)
 			return CSidlScreenWnd::WndNotification(self, sender, type, a4);
 	LABEL_11:
-		MakeGetBuffReturnSongs(is_song_window);
-		self->HandleSpellInfoDisplay(sender);
-		MakeGetBuffReturnSongs(false);
+		{
+			ScopedBuffView view(self, is_song_window);
+			self->HandleSpellInfoDisplay(sender);
+		}
 		return CSidlScreenWnd::WndNotification(self, sender, type, a4);
 	}
 	if (AltPressed())
 		goto LABEL_11;
-	for (int i = 0; i < EQ_NUM_BUFFS; i++) {
+	int num_slots = GetBuffWindowSlotCount(is_song_window);
+	for (int i = 0; i < num_slots; i++) {
 		if (self->Data.BuffButtonWnd[i] == sender) {
 			if (EQ_Character::IsValidAffect(EQ_OBJECT_CharInfo, i + start_buff_index))
 				EQ_Character::RemoveMyAffect(EQ_OBJECT_CharInfo, i + start_buff_index);
@@ -1076,25 +2333,56 @@ CShortBuffWindow* GetShortDurationBuffWindow() {
 	return ShortBuffWindow;
 }
 
+// CBuffWindow's constructor pushes its SIDL screen name with 'push offset "BuffWindow"' (0x00408D5A).
+// At load, that push is replaced once with a call to this thunk, which pushes whatever BuffWindow_ScreenName points to.
+// Building the song window is then just swapping a data pointer, instead of patching code on every UI init.
+const char* BuffWindow_ScreenName = nullptr; // Original name, read from the push when the thunk is installed
+bool BuffWindow_ScreenNameThunkInstalled = false;
+
+__declspec(naked) void BuffWindow_PushScreenName_Thunk()
+{
+	__asm {
+		push dword ptr [esp]          // ret, ret
+		push eax                      // eax, ret, ret
+		mov eax, BuffWindow_ScreenName
+		mov [esp + 8], eax            // eax, ret, name
+		pop eax                       // ret, name
+		ret                           // name (same stack/registers/flags as the original push)
+	}
+}
+
+void InstallBuffWindowScreenNameThunk()
+{
+	BYTE* push_inst = (BYTE*)Address(Address_BuffWindowScreenNamePush);
+	if (BuffWindow_ScreenNameThunkInstalled || !push_inst || push_inst[0] != 0x68) // Not the 'push imm32' we expect, leave it alone
+		return;
+
+	BuffWindow_ScreenName = *(const char**)&push_inst[1];
+
+	BYTE call_inst[5] = { 0xE8 };
+	*(uintptr_t*)&call_inst[1] = (uintptr_t)BuffWindow_PushScreenName_Thunk - ((uintptr_t)push_inst + 5);
+	PatchTransaction patch;
+	patch.Write((uintptr_t)push_inst, call_inst, sizeof(call_inst));
+	BuffWindow_ScreenNameThunkInstalled = patch.Commit();
+}
+
 void ShortBuffWindow_InitUI(CDisplay* cdisplay) {
 
-	if (ShortBuffWindow)
+	if (ShortBuffWindow || !BuffWindow_ScreenNameThunkInstalled || !Address(Address_GameHeap))
 		return;
 
-	CShortBuffWindow* wnd = reinterpret_cast<CShortBuffWindow*>(HeapAlloc(*(HANDLE*)0x80B420, 0, sizeof(_EQCBUFFWINDOW)));
+	CShortBuffWindow* wnd = reinterpret_cast<CShortBuffWindow*>(HeapAlloc(*(HANDLE*)Address(Address_GameHeap), 0, sizeof(_EQCBUFFWINDOW)));
 	if (wnd) {
 		memset(wnd, 0, sizeof(_EQCBUFFWINDOW));
 
-		// Need to patch the instruction to load our name 'ShortDurationBuffWindow' instead of 'BuffWindow'
-		BYTE orig_inst[5];
-		BYTE new_inst[5] = { 0x68, 0, 0 , 0, 0 };
-		*(uintptr_t*)&new_inst[1] = (uintptr_t)CShortBuffWindow::NAME;
-
-		PatchSwap(0x00408D5A, new_inst, 5, orig_inst);
+		// Load our name 'ShortDurationBuffWindow' instead of 'BuffWindow'
+		const char* buff_window_name = BuffWindow_ScreenName;
+		BuffWindow_ScreenName = CShortBuffWindow::NAME;
 		CBuffWindow::Consutrctor(wnd);
-		PatchSwap(0x00408D5A, orig_inst, 5);
+		BuffWindow_ScreenName = buff_window_name;
 
 		ShortBuffWindow = wnd;
+		SongWindowVisibility_Reset();
 	}
 }
 void ShortBuffWindow_CleanUI() {
@@ -1107,11 +2395,17 @@ void ShortBuffWindow_CleanUI() {
 		ShortBuffWindow->Destroy();
 	}
 	ShortBuffWindow = nullptr;
+	SongWindowVisibility_Reset();
+	SongLabelCache_Clear(); // Label windows are gone, so are the CXStrs we remembered
 }
 void ShowBuffWindow_ActivateUI(char c) {
 	if (ShortBuffWindow) {
 		ShortBuffWindow->LoadIniInfo();
 		ShortBuffWindow->Activate();
+		if (!SongWindow_HooksInstalled && ShortBuffWindow->IsVisibile()) // Shown by the handshake once it's usable
+			ShortBuffWindow->Show(0, 1);
+		ShortBuffWindow_ApplyCompactLayout();
+		SongWindowVisibility_Reset();
 	}
 }
 void ShowBuffWindow_DeactivateUI() {
@@ -1121,13 +2415,95 @@ void ShowBuffWindow_DeactivateUI() {
 	}
 }
 
+PatchTransaction SongWindowBytePatches; // Kept so the patches can be rolled back if the song window gets disabled
+
 void ApplySongWindowBytePatches() {
+	if (SongWindowBytePatches.IsCommitted())
+		return;
+	SongWindowBytePatches = PatchTransaction();
+
 	// HandleWorldMessage (OP_Buff): Has a hardcoded for-loop of only 15 buffs. Switching to 30.
 	// * '0x004E9F8E cmp 15' -> 'cmp 30'
 	// [0x83 0xFF 0x0F] -> [0x83 0xFF 0x1E]
 	BYTE patch[1] = { 0x1E };
-	int address = 0x004E9F8E + 2;
-	PatchSwap(address, patch, 1);
+	SongWindowBytePatches.Write(Address(Address_OPBuffSlotLoop) + 2, patch, 1);
+	SongWindowBytePatches.Commit();
+}
+void RemoveSongWindowBytePatches() {
+	SongWindowBytePatches.Rollback();
+}
+
+// -- [Lazy Hooks] --
+// Installed when the server enables the feature in the handshake, and removed again if a later handshake disables it,
+// so servers that never complete the handshake don't pay for a detour on every buff access.
+bool BuffstackingPatch_HooksInstalled = false;
+
+// Whether everything the hooks need was verified for this exe; the handshake doesn't offer what we can't install
+bool BuffstackingPatch_Available()
+{
+	return Address(Address_FindAffectSlot) != 0;
+}
+bool SongWindow_Available()
+{
+	return Address(Address_GetBuff) && Address(Address_GetMaxBuffs) && Address(Address_WndNotification) && Address(Address_OPBuffSlotLoop)
+		&& BuffWindow_ScreenNameThunkInstalled && Address(Address_GameHeap);
+}
+
+void BuffstackingPatch_SetHooksInstalled(bool install)
+{
+	if (install == BuffstackingPatch_HooksInstalled)
+		return;
+	if (install) {
+		EQCharacter__FindAffectSlot_Trampoline = (EQ_FUNCTION_TYPE_EQCharacter__FindAffectSlot)DetourAddress(Address_FindAffectSlot, (PBYTE)EQCharacter__FindAffectSlot_Detour);
+		BuffstackingPatch_HooksInstalled = EQCharacter__FindAffectSlot_Trampoline != nullptr;
+	}
+	else {
+		DetourRemove((PBYTE)EQCharacter__FindAffectSlot_Trampoline, (PBYTE)EQCharacter__FindAffectSlot_Detour);
+		BuffstackingPatch_HooksInstalled = false;
+	}
+}
+
+void SongWindow_SetHooksInstalled(bool install)
+{
+	if (install == SongWindow_HooksInstalled)
+		return;
+	if (install) {
+		if (!SongWindow_Available()) // All or nothing, half the hooks would corrupt buffs 16+
+			return;
+		EQCharacter__GetBuff_SetHook(g_bGetBuffInline ? GetBuffHookMode_Inline : GetBuffHookMode_Detour); // Supports reading buffs 16-30 in Song Window
+		EQCharacter__GetMaxBuffs_Trampoline = (EQ_FUNCTION_TYPE_EQCharacter__GetMaxBuffs)DetourAddress(Address_GetMaxBuffs, (PBYTE)EQCHARACTER__GetMaxBuffs_Detour); // Uses 16+ buffs for buff loops (stat calcs etc)
+		CBuffWindow__WndNotification_Trampoline = (EQ_FUNCTION_TYPE_CBuffWindow__WndNotification)DetourAddress(Address_WndNotification, (PBYTE)CBuffWindow__WndNotification_Detour); // Handles clicking off buffs 16+ on song window
+		ApplySongWindowBytePatches(); // Fixes OP_Buff to work on all 30 slots
+	}
+	else {
+		CShortBuffWindow* wnd = GetShortDurationBuffWindow();
+		if (wnd && wnd->IsVisibile()) // Hidden before its hooks go, see SongWindow_HooksInstalled
+			wnd->Show(0, 1);
+		RemoveSongWindowBytePatches();
+		DetourRemove((PBYTE)CBuffWindow__WndNotification_Trampoline, (PBYTE)CBuffWindow__WndNotification_Detour);
+		DetourRemove((PBYTE)EQCharacter__GetMaxBuffs_Trampoline, (PBYTE)EQCHARACTER__GetMaxBuffs_Detour);
+		EQCharacter__GetBuff_SetHook(GetBuffHookMode_None);
+	}
+	SongWindow_HooksInstalled = install;
+}
+
+// /getbuff [detour|inline] - Shows or switches how GetBuff is hooked, for comparing frame times
+void GetBuffHook_HandleCommand(const char* args)
+{
+	while (*args == ' ')
+		args++;
+	if (_stricmp(args, "inline") == 0 || _stricmp(args, "detour") == 0) {
+		g_bGetBuffInline = _stricmp(args, "inline") == 0;
+		WritePrivateProfileStringA("Defaults", "GetBuffInline", g_bGetBuffInline ? "TRUE" : "FALSE", "./eqclient.ini");
+		if (SongWindow_HooksInstalled) // Otherwise picked up when the handshake installs the hooks
+			EQCharacter__GetBuff_SetHook(g_bGetBuffInline ? GetBuffHookMode_Inline : GetBuffHookMode_Detour);
+	}
+	else if (*args != '\0') {
+		print_chat("Usage: /getbuff [detour|inline]");
+		return;
+	}
+	print_chat("GetBuff hook: %s (active: %s).", g_bGetBuffInline ? "inline" : "detour",
+		GetBuffHook_Installed == GetBuffHookMode_Inline ? "inline" : GetBuffHook_Installed == GetBuffHookMode_Detour ? "detour" : "none");
 }
 
 // ---------------------------------------------------------------------------------------
@@ -1155,6 +2531,30 @@ void CheckClientMiniMods()
 	{
 		g_bSongWindowAutoHide = false;
 	}
+
+	// Delays (ms) before the song window is auto-shown/auto-hidden. 0 (default) shows/hides immediately; a hide delay stops the
+	// window flickering between twisted songs.
+	g_songWindowShowDelayMs = GetPrivateProfileIntA("Defaults", "SongWindowShowDelay", -1, "./eqclient.ini");
+	if (g_songWindowShowDelayMs < 0) // Not found
+	{
+		g_songWindowShowDelayMs = 0;
+		WritePrivateProfileStringA("Defaults", "SongWindowShowDelay", "0", "./eqclient.ini");
+	}
+	g_songWindowHideDelayMs = GetPrivateProfileIntA("Defaults", "SongWindowHideDelay", -1, "./eqclient.ini");
+	if (g_songWindowHideDelayMs < 0) // Not found
+	{
+		g_songWindowHideDelayMs = 0;
+		WritePrivateProfileStringA("Defaults", "SongWindowHideDelay", "0", "./eqclient.ini");
+	}
+
+	// GetBuff hook mode (see /getbuff)
+	GetPrivateProfileStringA("Defaults", "GetBuffInline", "FALSE", szResult, 255, "./eqclient.ini");
+	g_bGetBuffInline = strcmp(szResult, "TRUE") == 0;
+
+	// Buff expiry alerts (see /buffalert)
+	char szAlerts[1024];
+	GetPrivateProfileStringA("Defaults", "BuffAlerts", "", szAlerts, sizeof(szAlerts), "./eqclient.ini");
+	BuffAlert_LoadRules(szAlerts);
 }
 
 //void CheckClientMiniMods()
@@ -1179,40 +2579,50 @@ void CheckClientMiniMods()
 
 void InitHooks()
 {
+	AddressResolver_Init(); // Before any hooks, so signatures see the original bytes
+	HookStats_Reset();
+
 	// Supports additional labels (Song Window, for now). Zeal handles most others.
-	GetLabelFromEQ_Trampoline = (EQ_FUNCTION_TYPE_GetLabelFromEQ)DetourFunction((PBYTE)0x436680, (PBYTE)GetLabelFromEQ_Detour);
+	GetLabelFromEQ_Trampoline = (EQ_FUNCTION_TYPE_GetLabelFromEQ)DetourAddress(Address_GetLabelFromEQ, (PBYTE)GetLabelFromEQ_Detour);
 
 	// Helper hooks that run callbacks
-	EnterZone_Trampoline = (EQ_FUNCTION_TYPE_EnterZone)DetourFunction((PBYTE)0x53D2C4, (PBYTE)EnterZone_Detour); // OnZone callbacks
-	HandleSpawnAppearanceMessage_Trampoline = (EQ_FUNCTION_TYPE_HandleSpawnAppearanceMessage)DetourFunction((PBYTE)0x004DF52A, (PBYTE)HandleSpawnAppearanceMessage_Detour); // OnSpawnAppearance(256) callbacks
-	InitGameUI_Trampoline = (EQ_FUNCTION_TYPE_InitGameUI)DetourFunction((PBYTE)0x004a60b5, (PBYTE)InitGameUI_Detour);
-	CleanUpUI_Trampoline = (EQ_FUNCTION_TYPE_CleanUpUI)DetourFunction((PBYTE)0x004A6EBC, (PBYTE)CleanUpUI_Detour);
-	ActivateUI_Trampoline = (EQ_FUNCTION_TYPE_ActivateUI)DetourFunction((PBYTE)0x004A741B, (PBYTE)ActivateUI_Detour);
-	DeactivateUI_Trampoline = (EQ_FUNCTION_TYPE_DeactivateUI)DetourFunction((PBYTE)0x4A7705, (PBYTE)DeactivateUI_Detour);
+	EnterZone_Trampoline = (EQ_FUNCTION_TYPE_EnterZone)DetourAddress(Address_EnterZone, (PBYTE)EnterZone_Detour); // OnZone callbacks
+	HandleSpawnAppearanceMessage_Trampoline = (EQ_FUNCTION_TYPE_HandleSpawnAppearanceMessage)DetourAddress(Address_HandleSpawnAppearanceMessage, (PBYTE)HandleSpawnAppearanceMessage_Detour); // OnSpawnAppearance(256) callbacks
+	InitGameUI_Trampoline = (EQ_FUNCTION_TYPE_InitGameUI)DetourAddress(Address_InitGameUI, (PBYTE)InitGameUI_Detour);
+	CleanUpUI_Trampoline = (EQ_FUNCTION_TYPE_CleanUpUI)DetourAddress(Address_CleanUpUI, (PBYTE)CleanUpUI_Detour);
+	ActivateUI_Trampoline = (EQ_FUNCTION_TYPE_ActivateUI)DetourAddress(Address_ActivateUI, (PBYTE)ActivateUI_Detour);
+	DeactivateUI_Trampoline = (EQ_FUNCTION_TYPE_DeactivateUI)DetourAddress(Address_DeactivateUI, (PBYTE)DeactivateUI_Detour);
+	RenderWorld_Trampoline = (EQ_FUNCTION_TYPE_RenderWorld)DetourAddress(Address_RenderWorld, (PBYTE)RenderWorld_Detour); // OnPulse callbacks
 
 	// Sends DLL_VERSION to the server on zone-in
-	OnZoneCallbacks.push_back(SendDllVersion_OnZone);
-	CustomSpawnAppearanceMessageHandlers.push_back(HandleDllVersionRequest);
+	OnZoneCallbacks.Add(AddressResolver_OnZone, CallbackPriority_Early);
+	OnZoneCallbacks.Add(SendDllVersion_OnZone, CallbackPriority_Early);
+	CustomSpawnAppearanceMessageHandlers.Add(HandleDllVersionRequest, CallbackPriority_Early);
 
 	// [BuffStackingPatch:Main]
-	EQCharacter__FindAffectSlot_Trampoline = (EQ_FUNCTION_TYPE_EQCharacter__FindAffectSlot)DetourFunction((PBYTE)0x004C7A3E, (PBYTE)EQCharacter__FindAffectSlot_Detour);
-	OnZoneCallbacks.push_back(BuffstackingPatch_OnZone);
-	CustomSpawnAppearanceMessageHandlers.push_back(BuffstackingPatch_HandleHandshake);
+	// FindAffectSlot is hooked once the handshake enables it (BuffstackingPatch_SetHooksInstalled)
+	OnZoneCallbacks.Add(BuffstackingPatch_OnZone);
+	CustomSpawnAppearanceMessageHandlers.Add(BuffstackingPatch_HandleHandshake);
 
 	// Command hook: handle /songs toggle
 	EQMACMQ_REAL_CEverQuest__InterpretCmd =
-		(EQ_FUNCTION_TYPE_CEverQuest__InterpretCmd)DetourFunction(
-			(PBYTE)EQ_FUNCTION_CEverQuest__InterpretCmd,   // symbol from eqmac_functions.h
+		(EQ_FUNCTION_TYPE_CEverQuest__InterpretCmd)DetourAddress(
+			Address_InterpretCmd,   // EQ_FUNCTION_CEverQuest__InterpretCmd unless a signature moved it
 			(PBYTE)EQMACMQ_DETOUR_CEverQuest__InterpretCmd
 		);
 
 	// [BuffStackingPacth:SongWindow]
-	EQCharacter__GetBuff_Trampoline = (EQ_FUNCTION_TYPE_EQCharacter__GetBuff)DetourFunction((PBYTE)0x004C465A, (PBYTE)EQCharacter__GetBuff_Detour); // Supports reading buffs 16-30 in Song Window
-	EQCharacter__GetMaxBuffs_Trampoline = (EQ_FUNCTION_TYPE_EQCharacter__GetMaxBuffs)DetourFunction((PBYTE)0x004C4637, (PBYTE)EQCHARACTER__GetMaxBuffs_Detour); // Uses 16+ buffs for buff loops (stat calcs etc)
-	DetourFunction((PBYTE)0x00408FF1, (PBYTE)CBuffWindow__WndNotification_Detour); // Handles clicking off buffs 16+ on song window
-	ApplySongWindowBytePatches(); // Fixes OP_Buff to work on all 30 slots
-	InitGameUICallbacks.push_back(ShortBuffWindow_InitUI); // Loads Song window
-	ActivateUICallbacks.push_back(ShowBuffWindow_ActivateUI);
-	CleanUpUICallbacks.push_back(ShortBuffWindow_CleanUI);
-	DeactivateUICallbacks.push_back(ShowBuffWindow_DeactivateUI);
+	// GetBuff/GetMaxBuffs/WndNotification and the OP_Buff patch are applied once the handshake gives us song slots (SongWindow_SetHooksInstalled)
+	InstallBuffWindowScreenNameThunk(); // Lets the song window reuse CBuffWindow's constructor
+	InitGameUICallbacks.Add(ShortBuffWindow_InitUI); // Loads Song window
+	ActivateUICallbacks.Add(ShowBuffWindow_ActivateUI);
+	CleanUpUICallbacks.Add(ShortBuffWindow_CleanUI);
+	DeactivateUICallbacks.Add(ShowBuffWindow_DeactivateUI);
+	OnPulseCallbacks.Add(SongWindowVisibility_Pulse); // Applies delayed song window auto-show/auto-hide
+
+	// Buff expiry alerts
+	BuffAlert_Reset();
+	OnPulseCallbacks.Add(BuffCountdown_Pulse, CallbackPriority_Early); // Before anything reads the timers this frame
+	OnPulseCallbacks.Add(BuffAlert_Pulse);
+	CleanUpUICallbacks.Add(BuffAlert_Reset, CallbackPriority_Late);
 }
\ No newline at end of file
@@ -0,0 +1,119 @@
+#ifndef HELM_MATERIAL_H
+#define HELM_MATERIAL_H
+
+#include <cstdint>
+
+// Velious helm materials for eqgame.cpp's OP_WearChange handling. Plain tables, so tests/helm_material_test.cpp can
+// check them against the switch they replaced.
+
+constexpr uint16_t kMaterialNone = 0;
+constexpr uint16_t kMaterialLeather = 1;
+constexpr uint16_t kMaterialChain = 2;
+constexpr uint16_t kMaterialPlate = 3;
+constexpr uint16_t kMaterialVeliousHelm = 240;
+constexpr uint16_t kMaterialVeliousHelmAlternate = 241; // A couple races support alternate helms
+
+// Converts Velious Helms to their common values.
+// We only send the canonical values to the server and other players.
+// - [5xx/6xx] -> [240] Swaps our racial Velious head model IT### back to the generic '240' value used by all Velious helms.
+// The rules below are expanded at compile time (MakeHelmMaterialTable) into a table over (race class, material), so
+// converting is a range check and one load.
+enum HelmRaceClass : uint8_t {
+	HelmRace_Other, // Not a playable race, materials pass through
+	HelmRace_Playable,
+	HelmRace_VahShir, // No custom helm, wears plate instead
+	HelmRace_Ogre, // Has an alternate helm
+	HelmRace_Count
+};
+
+struct HelmMaterialRule {
+	uint16_t material;
+	uint16_t canonical[HelmRace_Count];
+};
+
+constexpr HelmMaterialRule HelmMaterialRules[] = {
+	//              Other  Playable            Vah Shir         Ogre
+	// Vah Shir have their own material IDs when they equip leather/chain/plate helms, but no custom helm.
+	{ 661, { 661, kMaterialLeather, kMaterialLeather, kMaterialLeather } }, // VAH (F) Leather Helm
+	{ 666, { 666, kMaterialLeather, kMaterialLeather, kMaterialLeather } }, // VAH (M) Leather Helm
+	{ 662, { 662, kMaterialChain, kMaterialChain, kMaterialChain } }, // VAH (F) Chain Helm
+	{ 667, { 667, kMaterialChain, kMaterialChain, kMaterialChain } }, // VAH (M) Chain Helm
+	{ 663, { 663, kMaterialPlate, kMaterialPlate, kMaterialPlate } }, // VAH (F) Plate Helm
+	{ 668, { 668, kMaterialPlate, kMaterialPlate, kMaterialPlate } }, // VAH (M) Plate Helm
+	// Converts all the race-specific Velious Helm IT### numbers to the common 240 value
+	{ 665, { 665, kMaterialVeliousHelm, kMaterialPlate, kMaterialVeliousHelm } }, // vah
+	{ 660, { 660, kMaterialVeliousHelm, kMaterialPlate, kMaterialVeliousHelm } }, // vah
+	{ 627, { 627, kMaterialVeliousHelm, kMaterialPlate, kMaterialVeliousHelm } }, // hum
+	{ 620, { 620, kMaterialVeliousHelm, kMaterialPlate, kMaterialVeliousHelm } }, // hum
+	{ 537, { 537, kMaterialVeliousHelm, kMaterialPlate, kMaterialVeliousHelm } }, // bar
+	{ 530, { 530, kMaterialVeliousHelm, kMaterialPlate, kMaterialVeliousHelm } }, // bar
+	{ 570, { 570, kMaterialVeliousHelm, kMaterialPlate, kMaterialVeliousHelm } }, // eru
+	{ 575, { 575, kMaterialVeliousHelm, kMaterialPlate, kMaterialVeliousHelm } }, // eru
+	{ 565, { 565, kMaterialVeliousHelm, kMaterialPlate, kMaterialVeliousHelm } }, // elf
+	{ 561, { 561, kMaterialVeliousHelm, kMaterialPlate, kMaterialVeliousHelm } }, // elf
+	{ 605, { 605, kMaterialVeliousHelm, kMaterialPlate, kMaterialVeliousHelm } }, // hie
+	{ 600, { 600, kMaterialVeliousHelm, kMaterialPlate, kMaterialVeliousHelm } }, // hie
+	{ 545, { 545, kMaterialVeliousHelm, kMaterialPlate, kMaterialVeliousHelm } }, // def
+	{ 540, { 540, kMaterialVeliousHelm, kMaterialPlate, kMaterialVeliousHelm } }, // def
+	{ 595, { 595, kMaterialVeliousHelm, kMaterialPlate, kMaterialVeliousHelm } }, // hef
+	{ 590, { 590, kMaterialVeliousHelm, kMaterialPlate, kMaterialVeliousHelm } }, // hef
+	{ 557, { 557, kMaterialVeliousHelm, kMaterialPlate, kMaterialVeliousHelm } }, // dwf
+	{ 550, { 550, kMaterialVeliousHelm, kMaterialPlate, kMaterialVeliousHelm } }, // dwf
+	{ 655, { 655, kMaterialVeliousHelm, kMaterialPlate, kMaterialVeliousHelm } }, // trl
+	{ 650, { 650, kMaterialVeliousHelm, kMaterialPlate, kMaterialVeliousHelm } }, // trl
+	{ 645, { 645, kMaterialVeliousHelm, kMaterialPlate, kMaterialVeliousHelm } }, // ogr
+	{ 640, { 640, kMaterialVeliousHelm, kMaterialPlate, kMaterialVeliousHelm } }, // ogr
+	{ 615, { 615, kMaterialVeliousHelm, kMaterialPlate, kMaterialVeliousHelm } }, // hlf
+	{ 610, { 610, kMaterialVeliousHelm, kMaterialPlate, kMaterialVeliousHelm } }, // hlf
+	{ 585, { 585, kMaterialVeliousHelm, kMaterialPlate, kMaterialVeliousHelm } }, // gnm
+	{ 580, { 580, kMaterialVeliousHelm, kMaterialPlate, kMaterialVeliousHelm } }, // gnm
+	{ 635, { 635, kMaterialVeliousHelm, kMaterialPlate, kMaterialVeliousHelm } }, // iks
+	{ 630, { 630, kMaterialVeliousHelm, kMaterialPlate, kMaterialVeliousHelm } }, // iks
+	// Ogre Alternate Helm (Barbarian/RZ look)
+	{ 641, { 641, kMaterialVeliousHelm, kMaterialVeliousHelm, kMaterialVeliousHelmAlternate } }, // OGR (F)
+	{ 646, { 646, kMaterialVeliousHelm, kMaterialVeliousHelm, kMaterialVeliousHelmAlternate } }, // OGR (M)
+};
+
+constexpr uint16_t kHelmMaterialTableFirst = 530;
+constexpr uint16_t kHelmMaterialTableLast = 668;
+
+struct HelmMaterialTableData {
+	uint16_t canonical[HelmRace_Count][kHelmMaterialTableLast - kHelmMaterialTableFirst + 1];
+};
+
+// Expands HelmMaterialRules at compile time: every material in range passes through unless a rule says otherwise
+constexpr HelmMaterialTableData MakeHelmMaterialTable()
+{
+	HelmMaterialTableData table = {};
+	for (int race_class = 0; race_class < HelmRace_Count; race_class++) {
+		for (uint16_t material = kHelmMaterialTableFirst; material <= kHelmMaterialTableLast; material++)
+			table.canonical[race_class][material - kHelmMaterialTableFirst] = material;
+	}
+	for (const HelmMaterialRule& rule : HelmMaterialRules) {
+		for (int race_class = 0; race_class < HelmRace_Count; race_class++)
+			table.canonical[race_class][rule.material - kHelmMaterialTableFirst] = rule.canonical[race_class];
+	}
+	return table;
+}
+
+constexpr HelmMaterialTableData HelmMaterialTable = MakeHelmMaterialTable();
+
+inline HelmRaceClass GetHelmRaceClass(uint16_t race)
+{
+	if (race == 10)
+		return HelmRace_Ogre;
+	if (race == 130)
+		return HelmRace_VahShir;
+	if ((race >= 1 && race <= 12) || race == 128)
+		return HelmRace_Playable;
+	return HelmRace_Other;
+}
+
+inline uint16_t ToCanonicalHelmMaterial(uint16_t material, uint16_t race)
+{
+	if (material < kHelmMaterialTableFirst || material > kHelmMaterialTableLast)
+		return material;
+	return HelmMaterialTable.canonical[GetHelmRaceClass(race)][material - kHelmMaterialTableFirst];
+}
+
+#endif // HELM_MATERIAL_H
@@ -0,0 +1,128 @@
+#ifndef PATCH_TRANSACTION_H
+#define PATCH_TRANSACTION_H
+
+#include <windows.h>
+#include <cstring>
+#include <map>
+#include <vector>
+
+// Collects byte patches and applies them as one unit: each touched page is made writable once, the patched ranges are
+// flushed from the instruction cache, and if any page can't be unprotected nothing is written at all. Rollback() puts
+// back the original bytes of a committed transaction the same way. Shared by eqgame.cpp and eqa_songs.cpp.
+class PatchTransaction
+{
+public:
+	void Write(uintptr_t address, const void* bytes, size_t size)
+	{
+		Patch patch;
+		patch.address = address;
+		patch.bytes.assign((const BYTE*)bytes, (const BYTE*)bytes + size);
+		patches.push_back(patch);
+	}
+
+	// start_address (Inclusive), until_address (Exclusive)
+	void Nop(uintptr_t start_address, uintptr_t until_address)
+	{
+		if (until_address <= start_address)
+			return;
+		std::vector<BYTE> nops(until_address - start_address, 0x90);
+		for (size_t i = 0; i + 1 < nops.size(); i += 2)
+			nops[i] = 0x66; // 0x66 0x90 (safe, officially recognized as a 2-byte NOP).
+		Write(start_address, nops.data(), nops.size());
+	}
+
+	bool Commit()
+	{
+		if (committed)
+			return true;
+		if (!Unprotect())
+			return false;
+		for (auto& patch : patches) {
+			patch.original.assign((const BYTE*)patch.address, (const BYTE*)patch.address + patch.bytes.size());
+			memcpy((void*)patch.address, patch.bytes.data(), patch.bytes.size());
+		}
+		Flush();
+		Reprotect();
+		committed = true;
+		return true;
+	}
+
+	bool Rollback()
+	{
+		if (!committed)
+			return true;
+		if (!Unprotect())
+			return false;
+		for (auto it = patches.rbegin(); it != patches.rend(); ++it)
+			memcpy((void*)it->address, it->original.data(), it->original.size());
+		Flush();
+		Reprotect();
+		committed = false;
+		return true;
+	}
+
+	bool IsCommitted() const { return committed; }
+
+	// Bytes that were at patch 'index' before Commit()
+	const BYTE* Original(size_t index) const { return patches[index].original.data(); }
+
+private:
+	static const uintptr_t PatchPageSize = 0x1000;
+
+	struct Patch {
+		uintptr_t address;
+		std::vector<BYTE> bytes;
+		std::vector<BYTE> original;
+	};
+	std::vector<Patch> patches;
+	std::map<uintptr_t, DWORD> pages; // page -> protection to restore
+	bool committed = false;
+
+	bool Unprotect()
+	{
+		pages.clear();
+		for (auto& patch : patches) {
+			for (uintptr_t page = patch.address & ~(PatchPageSize - 1); page < patch.address + patch.bytes.size(); page += PatchPageSize)
+				pages[page] = 0;
+		}
+		for (auto it = pages.begin(); it != pages.end(); ++it) {
+			if (!VirtualProtect((void*)it->first, PatchPageSize, PAGE_EXECUTE_READWRITE, &it->second)) {
+				// Nothing written yet, just put back the pages we already changed
+				DWORD oldprotect;
+				for (auto undo = pages.begin(); undo != it; ++undo)
+					VirtualProtect((void*)undo->first, PatchPageSize, undo->second, &oldprotect);
+				pages.clear();
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void Reprotect()
+	{
+		DWORD oldprotect;
+		for (auto& page : pages)
+			VirtualProtect((void*)page.first, PatchPageSize, page.second, &oldprotect);
+		pages.clear();
+	}
+
+	// Each patched range on its own: patches can be far apart (PatchSaveBypass spans ~1 MB), and one low..high flush
+	// would cover everything in between.
+	void Flush()
+	{
+		HANDLE process = GetCurrentProcess();
+		for (auto& patch : patches)
+			FlushInstructionCache(process, (void*)patch.address, patch.bytes.size());
+	}
+};
+
+// copies target original value to buffer, then copies source to the target
+inline void PatchSwap(int target, BYTE* source, SIZE_T size, BYTE* buffer = nullptr)
+{
+	PatchTransaction patch;
+	patch.Write(target, source, size);
+	if (patch.Commit() && buffer)
+		memcpy((void*)buffer, patch.Original(0), size);
+}
+
+#endif // PATCH_TRANSACTION_H
@@ -0,0 +1,144 @@
+#ifndef SIGNATURE_SCAN_H
+#define SIGNATURE_SCAN_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <string>
+#include <vector>
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define SIGNATURE_SCAN_SSE2 1
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Byte signatures for the address resolver in eqa_songs.cpp. Only needs the standard library (and SSE2 where the
+// target has it), so tests/ builds it on Linux against synthetic images.
+
+// Pattern bytes, -1 = wildcard
+typedef std::vector<short> Signature;
+
+inline bool Signature_Matches(const uint8_t* at, const Signature& signature)
+{
+	for (size_t i = 0; i < signature.size(); i++) {
+		if (signature[i] >= 0 && at[i] != (uint8_t)signature[i])
+			return false;
+	}
+	return true;
+}
+
+// Index of the lowest set bit, mask must not be 0
+inline unsigned Signature_LowestBit(unsigned mask)
+{
+#ifdef _MSC_VER
+	unsigned long bit;
+	_BitScanForward(&bit, mask);
+	return (unsigned)bit;
+#else
+	return (unsigned)__builtin_ctz(mask);
+#endif
+}
+
+// Finds the only match of 'signature' in [begin, end), or nullptr if there are none or several.
+// SSE2 compares 16 positions at a time against the first non-wildcard byte, and only those hits get a full compare.
+inline const uint8_t* Signature_Scan(const uint8_t* begin, const uint8_t* end, const Signature& signature)
+{
+	size_t anchor = 0;
+	while (anchor < signature.size() && signature[anchor] < 0)
+		anchor++;
+	if (anchor == signature.size() || (size_t)(end - begin) < signature.size())
+		return nullptr;
+
+	const uint8_t* found = nullptr;
+	const uint8_t* p = begin + anchor;                         // Position of the anchor byte
+	const uint8_t* last = end - (signature.size() - anchor);   // Last position the anchor byte can be at
+#ifdef SIGNATURE_SCAN_SSE2
+	__m128i needle = _mm_set1_epi8((char)signature[anchor]);
+	for (; p + 16 <= last + 1; p += 16) {
+		unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)p), needle));
+		while (mask) {
+			const uint8_t* start = p + Signature_LowestBit(mask) - anchor;
+			mask &= mask - 1;
+			if (Signature_Matches(start, signature)) {
+				if (found)
+					return nullptr; // Not unique, can't trust it
+				found = start;
+			}
+		}
+	}
+#endif
+	for (; p <= last; p++) {
+		if (*p == (uint8_t)signature[anchor] && Signature_Matches(p - anchor, signature)) {
+			if (found)
+				return nullptr;
+			found = p - anchor;
+		}
+	}
+	return found;
+}
+
+// Turns 'length' bytes at a known-good address into a signature: rel32 operands of call/jmp and anything that looks like
+// an absolute address inside the image are wildcarded, since those move between builds.
+inline Signature Signature_Learn(const uint8_t* bytes, size_t length, uintptr_t image_begin, uintptr_t image_end)
+{
+	Signature signature(bytes, bytes + length);
+	for (size_t i = 0; i + 5 <= length; i++) {
+		if (bytes[i] == 0xE8 || bytes[i] == 0xE9) {
+			for (size_t j = 1; j <= 4; j++)
+				signature[i + j] = -1;
+		}
+	}
+	for (size_t i = 0; i + 4 <= length; i++) {
+		uint32_t value;
+		memcpy(&value, &bytes[i], sizeof(value));
+		if (value >= image_begin && value < image_end) {
+			for (size_t j = 0; j < 4; j++)
+				signature[i + j] = -1;
+		}
+	}
+	return signature;
+}
+
+inline std::string Signature_ToString(const Signature& signature)
+{
+	std::string text;
+	char hex[4];
+	for (size_t i = 0; i < signature.size(); i++) {
+		if (signature[i] < 0)
+			snprintf(hex, sizeof(hex), "??");
+		else
+			snprintf(hex, sizeof(hex), "%02X", (unsigned)(uint8_t)signature[i]);
+		if (i)
+			text += ' ';
+		text += hex;
+	}
+	return text;
+}
+
+inline Signature Signature_FromString(const char* text)
+{
+	Signature signature;
+	while (*text) {
+		while (*text == ' ')
+			text++;
+		if (text[0] == '?') {
+			signature.push_back(-1);
+			text += text[1] == '?' ? 2 : 1;
+		}
+		else if (isxdigit((unsigned char)text[0]) && isxdigit((unsigned char)text[1])) {
+			char hex[3] = { text[0], text[1], 0 };
+			signature.push_back((short)strtol(hex, nullptr, 16));
+			text += 2;
+		}
+		else {
+			break;
+		}
+	}
+	return signature;
+}
+
+#endif // SIGNATURE_SCAN_H
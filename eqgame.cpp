@@ -6,6 +6,11 @@
 //#include "..\zlib_x86\include\zlib.h"
 #include "eqmac.h"
 #include "eqmac_functions.h"
+#include "callback_registry.h"
+#include "patch_transaction.h"
+#include "delimited_file.h"
+#include "helm_material.h"
+#include "buff_view.h"
 #include "eqgame.h"
 #include <dxgi.h>
 #include <ctime>
@@ -17,6 +22,9 @@
 #include <random>
 #include <functional>
 #include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <bitset>
 
 // Sent on zone entry to the server.
 // Server uses this to tell the user if they are out of date.
@@ -96,14 +104,14 @@ BOOL bWindowedMode = true;
 BOOL RightHandMouse = true;
 
 // Callbacks run on zone
-std::vector<std::function<void()>> OnZoneCallbacks;
-std::vector<std::function<void(CDisplay*)>> InitGameUICallbacks;
-std::vector<std::function<void()>> DeactivateUICallbacks;
-std::vector<std::function<void(char)>> ActivateUICallbacks;
-std::vector<std::function<void()>> CleanUpUICallbacks;
+CallbackRegistry<void(*)(), 8> OnZoneCallbacks;
+CallbackRegistry<void(*)(CDisplay*), 8> InitGameUICallbacks;
+CallbackRegistry<void(*)(), 8> DeactivateUICallbacks;
+CallbackRegistry<void(*)(char), 8> ActivateUICallbacks;
+CallbackRegistry<void(*)(), 8> CleanUpUICallbacks;
 
 // Callbacks run on custom messages received via OP_SpawnAppearance
-std::vector<std::function<bool(DWORD feature_id,DWORD feature_value, bool is_request)>> CustomSpawnAppearanceMessageHandlers;
+CallbackRegistry<bool(*)(DWORD feature_id, DWORD feature_value, bool is_request), 8> CustomSpawnAppearanceMessageHandlers;
 
 typedef struct _detourinfo
 {
@@ -122,62 +130,26 @@ std::map<DWORD,_detourinfo> ourdetours;
 #define EzDetour(offset,detour,trampoline) AddDetourf((DWORD)offset,detour,trampoline)
 
 void PatchA(LPVOID address, const void *dwValue, SIZE_T dwBytes) {
-	unsigned long oldProtect;
-	VirtualProtect((void *)address, dwBytes, PAGE_EXECUTE_READWRITE, &oldProtect);
-	memcpy((void *)address, dwValue, dwBytes);
-	FlushInstructionCache(GetCurrentProcess(), (void*)address, dwBytes);
-	VirtualProtect((void *)address, dwBytes, oldProtect, &oldProtect);
-}
-
-// copies target original value to buffer, then copies source to the target
-void PatchSwap(int target, BYTE* source, SIZE_T size, BYTE* buffer = nullptr)
-{
-	DWORD oldprotect;
-	VirtualProtect((PVOID*)target, size, PAGE_EXECUTE_READWRITE, &oldprotect);
-	if (buffer)
-		memcpy((void*)buffer, (const void*)target, size);
-	memcpy((void*)target, (const void*)source, size);
-	FlushInstructionCache(GetCurrentProcess(), (void*)target, size);
-	VirtualProtect((PVOID*)target, size, oldprotect, &oldprotect);
+	PatchTransaction patch;
+	patch.Write((uintptr_t)address, dwValue, dwBytes);
+	patch.Commit();
 }
 
 // Patch 'call <Function>' instruction with a new function address
 void PatchCall(uintptr_t call_address, uintptr_t new_func_addr)
 {
-	unsigned long oldProtect;
-	uintptr_t relativeOffset = new_func_addr - (call_address + 5);
-	VirtualProtect((void*)call_address, 5, PAGE_EXECUTE_READWRITE, &oldProtect);
-	*(BYTE*)call_address = 0xE8;  // call opcode
-	*(uintptr_t*)(call_address + 1) = relativeOffset;  // new offset
-	FlushInstructionCache(GetCurrentProcess(), (void*)call_address, 5);
-	VirtualProtect((void*)call_address, 5, oldProtect, &oldProtect);
+	BYTE call[5] = { 0xE8 }; // call opcode
+	*(uintptr_t*)&call[1] = new_func_addr - (call_address + 5); // new offset
+	PatchTransaction patch;
+	patch.Write(call_address, call, sizeof(call));
+	patch.Commit();
 }
 
 // start_address (Inclusive), until_address (Exclusive)
 void PatchNopByRange(int start_address, int until_address) {
-
-	int size = until_address - start_address;
-	if (size <= 0) {
-		return;
-	}
-
-	int target = start_address;
-	BYTE nop2[] = { 0x66, 0x90 }; // 0x66 0x99 (safe, officially recognized as a 2-byte NOP).
-
-	DWORD oldprotect;
-	VirtualProtect((PVOID*)start_address, size, PAGE_EXECUTE_READWRITE, &oldprotect);
-
-	while (size >= 2) {
-		memcpy((void*)target, nop2, 2);
-		size -= 2;
-		target += 2;
-	}
-	if (size == 1) {
-		memcpy((void*)target, &nop2[1], 1);
-	}
-
-	FlushInstructionCache(GetCurrentProcess(), (void*)start_address, size);
-	VirtualProtect((PVOID*)start_address, size, oldprotect, &oldprotect);
+	PatchTransaction patch;
+	patch.Nop(start_address, until_address);
+	patch.Commit();
 }
 
 void UpdateTitle()
@@ -226,6 +198,366 @@ void print_chat(const char* format, ...)
 	print_chat_internal(*(int*)0x809478, buffer, 0, true);
 }
 
+// ---------------------------------------------------------------------------------------
+// Startup [Start]
+// DllMain runs under the loader lock. Settings are still loaded there: what LoadIniSettings and CheckClientMiniMods
+// read is used from CreateWindowExA, Render_World and code outside this file as soon as the client starts, SetEQhWnd
+// runs after LoadIniSettings as it always has, and CheckClientMiniMods decides whether the classic-music detours get
+// installed at all (it reads the IniStore cache, so it is cheap). Only the RaceData.txt parse (ActorTagTable) runs on
+// an init thread started from DllMain; its only readers, GetActorTag and /rnpcdata, call DeferredInit_Wait() first,
+// which costs one flag check once the thread is done.
+// Every phase is timed; /startup prints the timings (and LOGGING builds log them).
+
+struct StartupPhase {
+	const char* name;
+	double ms;
+	bool deferred; // Ran on the init thread
+};
+constexpr LONG MAX_STARTUP_PHASES = 16;
+StartupPhase StartupPhases[MAX_STARTUP_PHASES];
+volatile LONG StartupPhaseCount = 0;
+
+class StartupPhaseTimer {
+public:
+	StartupPhaseTimer(const char* name, bool deferred = false) : name(name), deferred(deferred) {
+		QueryPerformanceCounter(&start);
+	}
+	~StartupPhaseTimer() {
+		LARGE_INTEGER end, frequency;
+		QueryPerformanceCounter(&end);
+		QueryPerformanceFrequency(&frequency);
+		LONG index = InterlockedIncrement(&StartupPhaseCount) - 1;
+		if (index < MAX_STARTUP_PHASES)
+			StartupPhases[index] = { name, (end.QuadPart - start.QuadPart) * 1000.0 / frequency.QuadPart, deferred };
+	}
+private:
+	const char* name;
+	bool deferred;
+	LARGE_INTEGER start;
+};
+
+void StartupProfile_Print(bool to_chat)
+{
+	LONG count = StartupPhaseCount < MAX_STARTUP_PHASES ? StartupPhaseCount : MAX_STARTUP_PHASES;
+	double dllmain_ms = 0, deferred_ms = 0;
+	for (LONG i = 0; i < count; i++) {
+		char line[128];
+		sprintf_s(line, "EQGAME: Startup %s %s: %.2f ms", StartupPhases[i].deferred ? "(deferred)" : "(DllMain)", StartupPhases[i].name, StartupPhases[i].ms);
+		(StartupPhases[i].deferred ? deferred_ms : dllmain_ms) += StartupPhases[i].ms;
+		if (to_chat)
+			print_chat("%s", line + 8);
+#ifdef LOGGING
+		else
+			WriteLog(line);
+#endif
+	}
+	if (to_chat)
+		print_chat("Startup total: %.2f ms under the loader lock, %.2f ms deferred.", dllmain_ms, deferred_ms);
+}
+
+extern void InitRaceShortCodeMap();
+HANDLE DeferredInitDone = NULL; // Manual-reset event, signalled once the init thread has finished
+volatile LONG bDeferredInitDone = 0;
+
+DWORD WINAPI DeferredInit_ThreadProc(LPVOID)
+{
+	{
+		StartupPhaseTimer phase("InitRaceShortCodeMap", true);
+		InitRaceShortCodeMap();
+	}
+	StartupProfile_Print(false);
+	InterlockedExchange(&bDeferredInitDone, 1);
+	SetEvent(DeferredInitDone);
+	return 0;
+}
+
+// Called from DllMain. The thread doesn't actually start until the loader lock is released.
+void DeferredInit_Start()
+{
+	DeferredInitDone = CreateEventA(NULL, TRUE, FALSE, NULL);
+	HANDLE thread = DeferredInitDone ? CreateThread(NULL, 0, DeferredInit_ThreadProc, NULL, 0, NULL) : NULL;
+	if (thread)
+		CloseHandle(thread);
+	else
+		DeferredInit_ThreadProc(NULL); // Better late (and under the lock) than never
+}
+
+// Blocks until ActorTagTable is loaded. Never call this from DllMain.
+void DeferredInit_Wait()
+{
+	if (bDeferredInitDone)
+		return;
+	WaitForSingleObject(DeferredInitDone, INFINITE);
+}
+// Startup [End]
+// ---------------------------------------------------------------------------------------
+
+// ---------------------------------------------------------------------------------------
+// eqclient.ini Store [Start]
+// eqclient.ini is parsed once; our reads are hash lookups instead of the kernel re-opening and re-parsing the file
+// on every GetPrivateProfileStringA. Our writes only update memory and mark the key dirty. Dirty keys are written
+// back at camp (UI cleanup) and quit in one rewrite: the file is re-read from disk (other clients share it), only the
+// dirty keys are changed, and the result goes to a temp file that replaces the original. Never from DllMain: the
+// rewrite is too much to do under the loader lock, and at process detach the client is already torn down.
+// Writes the client makes itself through WritePrivateProfileStringA still go straight to disk (it may read them back)
+// and are mirrored here, as do the fixups InitHooks makes to settings the client reads in WinMain
+// (IniStore_WriteThrough). The exception is window positions, which are sent on every window move: those are coalesced
+// and written once the window has stayed put for a second.
+
+DWORD WINAPI WritePrivateProfileStringA_tramp(LPCSTR, LPCSTR, LPCSTR, LPCSTR);
+
+struct IniStoreEntry {
+	std::string section;
+	std::string key;
+	std::string value;
+	std::string file; // Pending position writes only
+};
+
+const char* IniStoreFile = "./eqclient.ini";
+char IniStoreFullPath[MAX_PATH] = { 0 };
+CRITICAL_SECTION IniStoreLock;
+bool IniStoreLoaded = false;
+std::unordered_map<std::string, std::string> IniStoreValues; // IniStore_Key(section, key) -> value
+std::unordered_map<std::string, IniStoreEntry> IniStoreDirty;
+std::unordered_map<std::string, IniStoreEntry> IniStorePendingPositions;
+DWORD IniStoreLastPositionWrite = 0;
+
+// INI lookups are case-insensitive
+std::string IniStore_Key(const std::string& section, const std::string& key)
+{
+	std::string result = section + '\n' + key;
+	for (char& c : result)
+		c = (char)tolower((unsigned char)c);
+	return result;
+}
+
+std::string IniStore_Trim(const std::string& text)
+{
+	size_t begin = text.find_first_not_of(" \t");
+	if (begin == std::string::npos)
+		return "";
+	size_t end = text.find_last_not_of(" \t");
+	return text.substr(begin, end - begin + 1);
+}
+
+// Splits an INI line. Returns 1 for '[section]', 2 for 'key=value', 0 for anything else (comments, blanks).
+int IniStore_ParseLine(const std::string& line, std::string& name, std::string& value)
+{
+	std::string trimmed = IniStore_Trim(line);
+	if (trimmed.empty() || trimmed[0] == ';')
+		return 0;
+	if (trimmed[0] == '[') {
+		size_t close = trimmed.find(']');
+		name = IniStore_Trim(trimmed.substr(1, close == std::string::npos ? std::string::npos : close - 1));
+		return 1;
+	}
+	size_t equals = trimmed.find('=');
+	if (equals == std::string::npos)
+		return 0;
+	name = IniStore_Trim(trimmed.substr(0, equals));
+	value = IniStore_Trim(trimmed.substr(equals + 1));
+	if (value.size() >= 2 && (value.front() == '"' || value.front() == '\'') && value.back() == value.front())
+		value = value.substr(1, value.size() - 2);
+	return 2;
+}
+
+std::vector<std::string> IniStore_ReadLines(const char* file_name)
+{
+	std::vector<std::string> lines;
+	std::ifstream file(file_name, std::ios::binary);
+	std::string line;
+	while (std::getline(file, line)) {
+		if (!line.empty() && line.back() == '\r')
+			line.pop_back();
+		lines.push_back(line);
+	}
+	return lines;
+}
+
+void IniStore_Index(const std::vector<std::string>& lines)
+{
+	IniStoreValues.clear();
+	std::string section, name, value;
+	for (const std::string& line : lines) {
+		int kind = IniStore_ParseLine(line, name, value);
+		if (kind == 1)
+			section = name;
+		else if (kind == 2)
+			IniStoreValues.emplace(IniStore_Key(section, name), value); // First one wins, like the kernel
+	}
+}
+
+void IniStore_Load()
+{
+	if (IniStoreLoaded)
+		return;
+	InitializeCriticalSection(&IniStoreLock);
+	GetFullPathNameA(IniStoreFile, MAX_PATH, IniStoreFullPath, NULL);
+	IniStore_Index(IniStore_ReadLines(IniStoreFile));
+	IniStoreLoaded = true;
+}
+
+// Copies the value (or 'default_value') into 'result' like GetPrivateProfileStringA. Returns false if the key isn't set.
+bool IniStore_Get(const char* section, const char* key, const char* default_value, char* result, size_t size)
+{
+	EnterCriticalSection(&IniStoreLock);
+	auto it = IniStoreValues.find(IniStore_Key(section, key));
+	bool found = it != IniStoreValues.end();
+	strncpy_s(result, size, found ? it->second.c_str() : default_value, _TRUNCATE);
+	LeaveCriticalSection(&IniStoreLock);
+	return found;
+}
+
+void IniStore_Set(const char* section, const char* key, const char* value)
+{
+	std::string index = IniStore_Key(section, key);
+	EnterCriticalSection(&IniStoreLock);
+	IniStoreValues[index] = value;
+	IniStoreDirty[index] = { section, key, value };
+	LeaveCriticalSection(&IniStoreLock);
+}
+
+// Keeps our copy in sync with a write the client made directly (WritePrivateProfileStringA_detour)
+void IniStore_Mirror(LPCSTR section, LPCSTR key, LPCSTR value, LPCSTR file_name)
+{
+	char full_path[MAX_PATH];
+	if (!IniStoreLoaded || !section || !file_name || !GetFullPathNameA(file_name, MAX_PATH, full_path, NULL) || _stricmp(full_path, IniStoreFullPath) != 0)
+		return;
+
+	EnterCriticalSection(&IniStoreLock);
+	if (!key) { // Whole section deleted
+		std::string prefix = IniStore_Key(section, "");
+		for (auto it = IniStoreValues.begin(); it != IniStoreValues.end();)
+			it = it->first.compare(0, prefix.size(), prefix) == 0 ? IniStoreValues.erase(it) : std::next(it);
+		for (auto it = IniStoreDirty.begin(); it != IniStoreDirty.end();)
+			it = it->first.compare(0, prefix.size(), prefix) == 0 ? IniStoreDirty.erase(it) : std::next(it);
+	}
+	else {
+		std::string index = IniStore_Key(section, key);
+		IniStoreDirty.erase(index); // The client's write is newer
+		if (value)
+			IniStoreValues[index] = value;
+		else
+			IniStoreValues.erase(index);
+	}
+	LeaveCriticalSection(&IniStoreLock);
+}
+
+// For settings the client reads itself before any flush point: written to disk now, and kept in sync here
+void IniStore_WriteThrough(const char* section, const char* key, const char* value)
+{
+	WritePrivateProfileStringA_tramp(section, key, value, IniStoreFile);
+	IniStore_Mirror(section, key, value, IniStoreFile);
+}
+
+void IniStore_QueuePosition(LPCSTR section, LPCSTR key, LPCSTR value, LPCSTR file_name)
+{
+	EnterCriticalSection(&IniStoreLock);
+	IniStorePendingPositions[std::string(file_name) + '\n' + IniStore_Key(section, key)] = { section, key, value, file_name };
+	IniStoreLastPositionWrite = GetTickCount();
+	LeaveCriticalSection(&IniStoreLock);
+}
+
+void IniStore_FlushPositions()
+{
+	EnterCriticalSection(&IniStoreLock);
+	std::unordered_map<std::string, IniStoreEntry> pending;
+	pending.swap(IniStorePendingPositions);
+	LeaveCriticalSection(&IniStoreLock);
+	for (auto& entry : pending) {
+		IniStoreEntry& position = entry.second;
+		WritePrivateProfileStringA_tramp(position.section.c_str(), position.key.c_str(), position.value.c_str(), position.file.c_str());
+		IniStore_Mirror(position.section.c_str(), position.key.c_str(), position.value.c_str(), position.file.c_str());
+	}
+}
+
+// Writes every dirty key in one rewrite of the file
+void IniStore_Flush()
+{
+	if (!IniStoreLoaded)
+		return;
+	IniStore_FlushPositions();
+
+	EnterCriticalSection(&IniStoreLock);
+	if (IniStoreDirty.empty()) {
+		LeaveCriticalSection(&IniStoreLock);
+		return;
+	}
+
+	std::vector<std::string> lines = IniStore_ReadLines(IniStoreFile);
+	std::unordered_map<std::string, IniStoreEntry> remaining = IniStoreDirty;
+	std::vector<std::string> output;
+	std::string section, name, value;
+	auto append_remaining = [&](const std::string& section) {
+		for (auto it = remaining.begin(); it != remaining.end();) {
+			if (_stricmp(it->second.section.c_str(), section.c_str()) == 0) {
+				output.push_back(it->second.key + "=" + it->second.value);
+				it = remaining.erase(it);
+			}
+			else {
+				++it;
+			}
+		}
+	};
+	bool seen_section = false;
+	for (const std::string& line : lines) {
+		int kind = IniStore_ParseLine(line, name, value);
+		if (kind == 1) {
+			if (seen_section)
+				append_remaining(section);
+			section = name;
+			seen_section = true;
+		}
+		else if (kind == 2) {
+			auto it = remaining.find(IniStore_Key(section, name));
+			if (it != remaining.end()) {
+				output.push_back(name + "=" + it->second.value);
+				remaining.erase(it);
+				continue;
+			}
+		}
+		output.push_back(line);
+	}
+	if (seen_section)
+		append_remaining(section);
+	while (!remaining.empty()) { // Sections that don't exist yet
+		std::string new_section = remaining.begin()->second.section;
+		output.push_back("[" + new_section + "]");
+		append_remaining(new_section);
+	}
+
+	std::string temp_file = std::string(IniStoreFullPath) + ".tmp";
+	bool written = false;
+	{
+		std::ofstream file(temp_file, std::ios::binary | std::ios::trunc);
+		for (const std::string& line : output)
+			file << line << "\r\n";
+		written = file.good();
+	}
+	if (written && MoveFileExA(temp_file.c_str(), IniStoreFullPath, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+		IniStoreDirty.clear();
+		IniStore_Index(output); // Also picks up what other clients wrote since we loaded
+	}
+#ifdef LOGGING
+	else {
+		WriteLog("IniStore_Flush: Failed to write " + std::string(IniStoreFullPath) + ", will retry at the next flush.");
+	}
+#endif
+	LeaveCriticalSection(&IniStoreLock);
+}
+
+// Writes coalesced window positions once they've settled
+void IniStore_Pulse()
+{
+	EnterCriticalSection(&IniStoreLock);
+	bool settled = !IniStorePendingPositions.empty() && GetTickCount() - IniStoreLastPositionWrite > 1000;
+	LeaveCriticalSection(&IniStoreLock);
+	if (settled)
+		IniStore_FlushPositions();
+}
+// eqclient.ini Store [End]
+// ---------------------------------------------------------------------------------------
+
 void __cdecl ResetMouseFlags() {
 #ifdef LOGGING
 	WriteLog("EQGAME: Resetting Mouse Flags");
@@ -354,8 +686,8 @@ typedef void(__thiscall* EQ_FUNCTION_TYPE_EnterZone)(void* this_ptr, int hwnd);
 EQ_FUNCTION_TYPE_EnterZone EnterZone_Trampoline;
 void __fastcall EnterZone_Detour(void* this_ptr, int unused, int hwnd) {
 	EnterZone_Trampoline(this_ptr, hwnd);
-	for (auto& callback : OnZoneCallbacks) {
-		callback();
+	for (auto& entry : OnZoneCallbacks) {
+		entry.callback();
 	}
 }
 
@@ -365,8 +697,8 @@ EQ_FUNCTION_TYPE_InitGameUI InitGameUI_Trampoline;
 int __fastcall InitGameUI_Detour(CDisplay* cdisplay, int unused)
 {
 	int res = InitGameUI_Trampoline(cdisplay);
-	for (auto& callback : InitGameUICallbacks) {
-		callback(cdisplay);
+	for (auto& entry : InitGameUICallbacks) {
+		entry.callback(cdisplay);
 	}
 	return res;
 }
@@ -377,8 +709,8 @@ EQ_FUNCTION_TYPE_CleanUpUI CleanUpUI_Trampoline;
 void* CleanUpUI_Detour()
 {
 	void* res = CleanUpUI_Trampoline();
-	for (auto& callback : CleanUpUICallbacks) {
-		callback();
+	for (auto& entry : CleanUpUICallbacks) {
+		entry.callback();
 	}
 	return res;
 }
@@ -389,8 +721,8 @@ EQ_FUNCTION_TYPE_ActivateUI ActivateUI_Trampoline;
 int __stdcall ActivateUI_Detour(char a1)
 {
 	int res = ActivateUI_Trampoline(a1);
-	for (auto& callback : ActivateUICallbacks) {
-		callback(a1);
+	for (auto& entry : ActivateUICallbacks) {
+		entry.callback(a1);
 	}
 	return res;
 }
@@ -400,8 +732,8 @@ typedef int(* EQ_FUNCTION_TYPE_DeactivateUI)(void);
 EQ_FUNCTION_TYPE_DeactivateUI DeactivateUI_Trampoline;
 int DeactivateUI_Detour() {
 	int res = DeactivateUI_Trampoline();
-	for (auto& callback : DeactivateUICallbacks) {
-		callback();
+	for (auto& entry : DeactivateUICallbacks) {
+		entry.callback();
 	}
 	return res;
 }
@@ -431,8 +763,8 @@ void HandleCustomSpawnAppearanceMessage(SpawnAppearance_Struct* message)
 		bool is_request = (message->parameter >> 31) == 0;
 		DWORD feature_id = message->parameter >> 16 & 0x7FFFu;
 		DWORD feature_value = message->parameter & 0xFFFFu;
-		for (auto& handler : CustomSpawnAppearanceMessageHandlers) {
-			if (handler(feature_id, feature_value, is_request)) {
+		for (auto& entry : CustomSpawnAppearanceMessageHandlers) {
+			if (entry.callback(feature_id, feature_value, is_request)) {
 				return;
 			}
 		}
@@ -497,6 +829,23 @@ int g_prevGlobalMusicTrack = 0;
 int __cdecl msg_send_corpse_equip(class EQ_Equipment *);
 FUNCTION_AT_ADDRESS(int __cdecl msg_send_corpse_equip(class EQ_Equipment *),0x4DF03D);
 int base_val = 362;
+class Eqmachooks;
+bool WearChangeQueue_Push(Eqmachooks* everquest, DWORD* con, char* buffer, unsigned __int32 len);
+void WearChangeQueue_Flush();
+void WearChangeQueue_BeforeMessage(unsigned __int32 opcode, const char* buffer, unsigned __int32 len);
+extern unsigned char WearChangeQueue_HandledResult;
+extern bool WearChangeQueue_HandledResultKnown;
+void SpellAffectCache_Invalidate();
+// Invalidates the spell affect cache on construction and again on destruction, so totals read while a buff-changing
+// call runs and totals read after it returns are both recomputed from the slots it wrote.
+struct SpellAffectCacheWriteScope {
+	SpellAffectCacheWriteScope() { SpellAffectCache_Invalidate(); }
+	~SpellAffectCacheWriteScope() { SpellAffectCache_Invalidate(); }
+	SpellAffectCacheWriteScope(const SpellAffectCacheWriteScope&) = delete;
+	SpellAffectCacheWriteScope& operator=(const SpellAffectCacheWriteScope&) = delete;
+};
+void HorseRace_Pulse();
+extern bool HorseRace_Pending;
 class Eqmachooks {
 public:
 
@@ -630,6 +979,8 @@ public:
 	unsigned char CEverQuest__HandleWorldMessage_Detour(DWORD *con,unsigned __int32 Opcode,char *Buffer,unsigned __int32 len)
 	{
 		//std::cout << "Opcode: 0x" << std::hex << Opcode << std::endl;
+		WearChangeQueue_BeforeMessage(Opcode, Buffer, len); // Keeps queued WearChanges ahead of later messages for the same spawn
+		SpellAffectCacheWriteScope spell_affect_cache_scope; // Buffs, level and gear change through server messages, on every return path
 		if(Opcode==0x4052) {//OP_ItemOnCorpse
 			return msg_send_corpse_equip((EQ_Equipment*)Buffer);
 		}
@@ -696,9 +1047,20 @@ public:
 			WriteLog("EQGAME: CEverQuest__HandleWorldMessage_Detour OP_LogServer=0xc341 Can go Fullscreen (1)");
 #endif
 		}
+		else if (Opcode == 0x4146 || Opcode == 0x4091) { // OP_NewSpawn, OP_Illusion: a race the horse tables may not have yet
+			unsigned char result = CEverQuest__HandleWorldMessage_Trampoline(con, Opcode, Buffer, len);
+			HorseRace_Pending = true;
+			HorseRace_Pulse(); // Classified before a mount message can ask about it
+			return result;
+		}
 		else if (Opcode == 0x4092 && len >= sizeof(WearChange_Struct))
 		{
+			if (WearChangeQueue_Push(this, con, Buffer, len))
+				return WearChangeQueue_HandledResult; // Applied with the rest of the frame's WearChanges (WearChangeQueue_Flush)
 			Handle_In_OP_WearChange((WearChange_Struct*)Buffer);
+			WearChangeQueue_HandledResult = CEverQuest__HandleWorldMessage_Trampoline(con, Opcode, Buffer, len);
+			WearChangeQueue_HandledResultKnown = true;
+			return WearChangeQueue_HandledResult;
 		}
 		return CEverQuest__HandleWorldMessage_Trampoline(con,Opcode,Buffer,len);
 	}
@@ -912,6 +1274,10 @@ public:
 	int CDisplay__Render_World_Trampoline();
 	int CDisplay__Render_World_Detour()
 	{
+		IniStore_Pulse();
+		WearChangeQueue_Flush();
+		SpellAffectCache_Invalidate();
+		HorseRace_Pulse();
 		Pulse();
 		return CDisplay__Render_World_Trampoline();
 	}
@@ -954,6 +1320,110 @@ DETOUR_TRAMPOLINE_EMPTY(int __cdecl  Eqmachooks::CDisplay__Process_Events_Trampo
 DETOUR_TRAMPOLINE_EMPTY(HWND WINAPI CreateWindowExA_Trampoline(DWORD,LPCSTR,LPCSTR,DWORD,int,int,int,int,HWND,HMENU,HINSTANCE,LPVOID));
 DETOUR_TRAMPOLINE_EMPTY(int __cdecl HandleMouseWheel_Trampoline(int));
 DETOUR_TRAMPOLINE_EMPTY(int sub_4F35E5_Trampoline()); // command line parsing
+
+// ---------------------------------------------------------------------------------------
+// Inbound OP_WearChange Queue [Start]
+// Zone-in and raid form-up bring bursts of OP_WearChange, often several for the same spawn and slot, and each one swaps
+// models and re-tints right away (WearChangeArmor/SwapHead/SwapModel). Instead they're queued by (spawn id, wear slot),
+// keeping only the latest, and handed to the client once per frame (or sooner if the queue gets old).
+// An entry is only applied if its spawn id still finds the same spawn, so a despawn in between can't put gear on the
+// wrong spawn. Packets for spawns we don't know yet go straight through, as before.
+// Arrival order still holds per spawn: the queue is flushed before any other message for a queued spawn that changes
+// its model or id (OP_Illusion, OP_SpawnAppearance, OP_DeleteSpawn), and before every OP_NewSpawn, which may reuse the
+// id of a spawn that left without an OP_DeleteSpawn. The queue is dropped on zone change and UI cleanup.
+
+constexpr unsigned __int32 kOpWearChange = 0x4092;
+constexpr unsigned __int32 kOpIllusion = 0x4091; // OP_Illusion=0x9140
+constexpr unsigned __int32 kOpSpawnAppearance = 0x40F5; // OP_SpawnAppearance=0xf540
+constexpr unsigned __int32 kOpDeleteSpawn = 0x402A; // OP_DeleteSpawn=0x2a40
+constexpr unsigned __int32 kOpNewSpawn = 0x4146; // OP_NewSpawn=0x4641
+constexpr DWORD kWearChangeQueueMaxAgeMs = 100;
+
+struct QueuedWearChange {
+	EQSPAWNINFO* entity;
+	unsigned __int32 len;
+	char buffer[32];
+};
+
+Eqmachooks* WearChangeQueue_CEverQuest = nullptr;
+DWORD* WearChangeQueue_Connection = nullptr;
+std::vector<QueuedWearChange> WearChangeQueue;
+std::unordered_map<DWORD, size_t> WearChangeQueueIndex; // (spawn id << 8) | wear slot -> WearChangeQueue index
+std::unordered_set<WORD> WearChangeQueueSpawns; // Spawn ids with a queued entry
+DWORD WearChangeQueue_OldestTime = 0;
+// What the client returns for a WearChange, given back for queued ones. Nothing is queued until one has gone through.
+unsigned char WearChangeQueue_HandledResult = 0;
+bool WearChangeQueue_HandledResultKnown = false;
+
+void WearChangeQueue_Clear()
+{
+	WearChangeQueue.clear();
+	WearChangeQueueIndex.clear();
+	WearChangeQueueSpawns.clear();
+}
+
+void WearChangeQueue_Flush()
+{
+	for (QueuedWearChange& queued : WearChangeQueue) {
+		WearChange_Struct* wc = (WearChange_Struct*)queued.buffer;
+		if (EQPlayer::GetSpawn(wc->spawn_id) != queued.entity)
+			continue; // Despawned since
+		Handle_In_OP_WearChange(wc);
+		WearChangeQueue_HandledResult = WearChangeQueue_CEverQuest->CEverQuest__HandleWorldMessage_Trampoline(WearChangeQueue_Connection, kOpWearChange, queued.buffer, queued.len);
+	}
+	WearChangeQueue_Clear();
+}
+
+// Called for every world message before it's handled
+void WearChangeQueue_BeforeMessage(unsigned __int32 opcode, const char* buffer, unsigned __int32 len)
+{
+	if (WearChangeQueue.empty())
+		return;
+	switch (opcode)
+	{
+	case kOpIllusion:
+	case kOpSpawnAppearance:
+	case kOpDeleteSpawn:
+		// All three start with the spawn id
+		if (len < sizeof(WORD) || WearChangeQueueSpawns.count(*(const WORD*)buffer))
+			WearChangeQueue_Flush();
+		break;
+	case kOpNewSpawn:
+		WearChangeQueue_Flush();
+		break;
+	}
+}
+
+// Returns false if the packet has to be handled now
+bool WearChangeQueue_Push(Eqmachooks* everquest, DWORD* con, char* buffer, unsigned __int32 len)
+{
+	WearChange_Struct* wc = (WearChange_Struct*)buffer;
+	EQSPAWNINFO* entity = EQPlayer::GetSpawn(wc->spawn_id);
+	if (!entity || len > sizeof(QueuedWearChange::buffer) || !WearChangeQueue_HandledResultKnown)
+		return false;
+
+	if (!WearChangeQueue.empty() && (WearChangeQueue_CEverQuest != everquest || WearChangeQueue_Connection != con || GetTickCount() - WearChangeQueue_OldestTime > kWearChangeQueueMaxAgeMs))
+		WearChangeQueue_Flush();
+	if (WearChangeQueue.empty())
+		WearChangeQueue_OldestTime = GetTickCount();
+	WearChangeQueue_CEverQuest = everquest;
+	WearChangeQueue_Connection = con;
+
+	DWORD key = ((DWORD)wc->spawn_id << 8) | wc->wear_slot_id;
+	auto it = WearChangeQueueIndex.find(key);
+	if (it == WearChangeQueueIndex.end()) {
+		it = WearChangeQueueIndex.emplace(key, WearChangeQueue.size()).first;
+		WearChangeQueue.emplace_back();
+	}
+	WearChangeQueueSpawns.insert(wc->spawn_id);
+	QueuedWearChange& queued = WearChangeQueue[it->second];
+	queued.entity = entity;
+	queued.len = len;
+	memcpy(queued.buffer, buffer, len);
+	return true;
+}
+// Inbound OP_WearChange Queue [End]
+// ---------------------------------------------------------------------------------------
 DETOUR_TRAMPOLINE_EMPTY(int WINAPI sub_4B8231_Trampoline(int, signed int)); // MGB for BST
 DETOUR_TRAMPOLINE_EMPTY(int Eqmachooks::CDisplay__StartWorldDisplay_Trampoline(int zoneindex, int x));
 
@@ -970,6 +1440,7 @@ int __cdecl CEverQuest__SendMessage_Detour(int* connection, int opcode, char* bu
 		if (Handle_Out_OP_WearChange((WearChange_Struct*)buffer))
 			return 0;
 	}
+	SpellAffectCacheWriteScope spell_affect_cache_scope; // Local buff and gear changes (click-offs, item moves) are sent to the server
 	return CEverQuest__SendMessage_Trampoline(connection, opcode, buffer, len, unknown);
 }
 
@@ -1006,6 +1477,7 @@ int __fastcall EQMACMQ_DETOUR_CCharacterSelectWnd__Quit(void* this_ptr, void* no
 		first_maximize = true;
 	}
 
+	IniStore_Flush();
 	return EQMACMQ_REAL_CCharacterSelectWnd__Quit(this_ptr);
 }
 
@@ -1185,9 +1657,10 @@ void __fastcall EQMACMQ_DETOUR_CBuffWindow__RefreshBuffDisplay(CBuffWindow* this
 	bool is_song_window = (this_ptr == GetShortDurationBuffWindow());
 	_EQBUFFINFO* buffs = GetStartBuffArray(is_song_window);
 
-	MakeGetBuffReturnSongs(is_song_window);
-	EQMACMQ_REAL_CBuffWindow__RefreshBuffDisplay(this_ptr);
-	MakeGetBuffReturnSongs(false);
+	{
+		ScopedBuffView view(this_ptr, is_song_window);
+		EQMACMQ_REAL_CBuffWindow__RefreshBuffDisplay(this_ptr);
+	}
 
 	int num_buffs = 0;
 
@@ -1623,17 +2096,19 @@ int __cdecl HandleMouseWheel_Detour(int a1) {
 
 void PatchSaveBypass()
 {
+	PatchTransaction patches;
+
 	//const char test1[] =  { 0xEB, 0x21 };
 	//PatchA((DWORD*)0x0052B70A, &test1, sizeof(test1));
 	const char test1[] = { 0x00, 0x00 };
-	PatchA((DWORD*)0x0052B716, &test1, sizeof(test1));
+	patches.Write(0x0052B716, test1, sizeof(test1));
 	// OP_Save
 	// this stops sending OP_SAVE
 	//const char test2[] = { 0x90, 0x90, 0x90, 0x90, 0x90 };
 	//PatchA((DWORD*)0x00536797, &test2, sizeof(test2));
 	// this forces sending OP_SAVE with size of 0.
 	const char test2[] = { 0x00, 0x00 };
-	PatchA((DWORD*)0x0053678C, &test2, sizeof(test2));
+	patches.Write(0x0053678C, test2, sizeof(test2));
 
 	//SetCooperativeLevel to 0x06 instead of 0x10 for eqgame.exe
 	//const char test3[] = { 0x06 };
@@ -1673,28 +2148,28 @@ void PatchSaveBypass()
 
 	// Face picker patch.
 	const char test12[] = { 0x90, 0x90, 0x90, 0x90, 0x90, 0x90, 0xEB };
-	PatchA((DWORD*)0x005431C1, &test12, sizeof(test12));
+	patches.Write(0x005431C1, test12, sizeof(test12));
 
 	if (g_bEnableBrownSkeletons)
 	{
 		const char test13[] = { 0x90, 0x90, 0x90, 0x90, 0x90, 0x90, 0x90, 0x90, 0xEB };
-		PatchA((DWORD*)0x0049F28F, &test13, sizeof(test13));
+		patches.Write(0x0049F28F, test13, sizeof(test13));
 	}
 
 	const char test14[] = { 0xEB, 0x1A };
-	PatchA((DWORD*)0x42D14D, &test14, sizeof(test14));
+	patches.Write(0x42D14D, test14, sizeof(test14));
 
 	//Changes the limit to 0x3E8 (1000) on race animations.
 	const char test15[] = { 0xE8, 0x03 };
-	PatchA((DWORD*)0x004AE612, &test15, sizeof(test15));
+	patches.Write(0x004AE612, test15, sizeof(test15));
 
 	//Changes the limit to 0x3E8 (1000) on race animations.
 	const char test16[] = { 0xE8, 0x03 };
-	PatchA((DWORD*)0x4d93c5, &test16, sizeof(test16));
+	patches.Write(0x4d93c5, test16, sizeof(test16));
 
 	//Changes the limit to 0x3E8 (1000) on race spawning to apply sounds and textures.
 	const char test17[] = { 0xE8, 0x03 };
-	PatchA((DWORD*)0x50704c, &test17, sizeof(test17));
+	patches.Write(0x50704c, test17, sizeof(test17));
 
 	////Patch the trampoline for untextured horse to check its validity. currently hardcoded to IDs in hook, but this bypasses the initial check. 11 nops.
 	//const char test18[] = { 0x90,0x90,0x90,0x90,0x90,0x90,0x90,0x90,0x90,0x90,0x90 };
@@ -1706,6 +2181,13 @@ void PatchSaveBypass()
 	////Patch the check for Horse ID to allow for more IDs than just 216. 15 nops.
 	//const char test19[] = { 0x90,0x90,0x90,0x90,0x90,0x90,0x90,0x90,0x90,0x90,0x90,0x90,0x90,0x90,0x90 };
 	//PatchA((DWORD*)0x4B07D7, &test19, sizeof(test19));
+
+	if (!patches.Commit())
+	{
+#ifdef LOGGING
+		WriteLog("PatchSaveBypass: Failed to unprotect code pages, no patches applied.");
+#endif
+	}
 }
 
 typedef int(__cdecl *_s3dSetStringSpriteYonClip)(intptr_t, int, float);
@@ -1899,6 +2381,7 @@ int __cdecl do_quit_Detour(int a1, int a2) {
 			}
 		}
 	}
+	IniStore_Flush();
 	return do_quit_Trampoline(a1, a2);
 }
 typedef int(__thiscall* EQ_FUNCTION_TYPE_EQPlayer__LegalPlayerRace)(void* this_ptr, int a3);
@@ -1915,8 +2398,20 @@ int __fastcall LegalPlayerRace_Detour(void* this_ptr, void* not_used, int a3) {
 // Legacy Model Horse Support
 // --------------------------------------------------------------------------
 
-// Cache of which races have a RIDER_DAG
-std::map<WORD, bool> is_horse_map;
+// Per-race horse classification, so IsHorse, GetRiderDag and FakeHorseRace (called from the mount, movement and
+// controls hooks) are a table read. A race is classified once a spawn of it has a model: HorseRaceIsHorse says whether
+// that model has a RIDER_DAG and HorseRaceRiderDag holds it. Models are loaded per zone, so the tables are rebuilt on
+// every zone-in (HorseRace_OnZone) from the spawns there. Races that show up later are classified right after their
+// OP_NewSpawn or OP_Illusion is handled, or by a later frame's HorseRace_Pulse if the model isn't there yet. A race
+// whose spawns still have no model after kHorseRaceModelWaitFrames is recorded as not a horse, so it never costs a
+// lookup again. Playable races and 216 are seeded and never looked up.
+constexpr int kHorseRaceModelWaitFrames = 60;
+std::bitset<65536> HorseRaceClassified;
+std::bitset<65536> HorseRaceIsHorse;
+EQDAGINFO* HorseRaceRiderDag[65536];
+std::vector<WORD> HorseRaceClassifiedRaces; // Looked-up races, cleared on zone-in
+bool HorseRace_Pending = false;
+int HorseRace_PendingFrames = 0;
 
 thread_local WORD ActualHorseRaceID = 0;
 
@@ -1932,7 +2427,8 @@ EQDAGINFO* GetHeirarchicalSpriteDagByName(EQMODELINFO* sprite, char* dag_name)
 	return reinterpret_cast<EQDAGINFO*(__cdecl*)(EQMODELINFO*, char*)>(*(int*)0x7F9A0C)(sprite, dag_name);
 }
 
-EQDAGINFO* GetRiderDag(EQSPAWNINFO* entity)
+// The actual lookup (GetActorTag, sprintf and the DAG search), only used to fill the tables
+EQDAGINFO* HorseRace_LookupRiderDag(EQSPAWNINFO* entity)
 {
 	if (!entity || !entity->ActorInfo || !entity->ActorInfo->ModelInfo || entity->ActorInfo->ModelInfo->Type != 20)
 		return nullptr;
@@ -1951,45 +2447,107 @@ EQDAGINFO* GetRiderDag(EQSPAWNINFO* entity)
 	return dag;
 }
 
-// Replaced the basic EQ IsHorse() function which only checks Race == 216
-bool __fastcall IsHorse(EQSPAWNINFO* entity, int unused)
+void HorseRace_Init()
 {
-	if (!entity)
-		return false;
+	const WORD not_horses[] = {
+		0, // none
+		1, // hum
+		2, // bar
+		3, // eru
+		4, // elf
+		5, // hie
+		6, // def
+		7, // hef
+		8, // dwaf
+		9, // trol
+		10, // ogr
+		11, // hlf
+		12, // gnm
+		26, // frg
+		27, // frg
+		128, // isk
+		130, // vah
+	};
+	for (WORD race : not_horses)
+		HorseRaceClassified.set(race);
+	HorseRaceClassified.set(216); // horse
+	HorseRaceIsHorse.set(216);
+}
 
-	WORD race = entity->Race;
-	switch (race)
-	{
-	case 0: // none
-	case 1: // hum
-	case 2: // bar
-	case 3: // eru
-	case 4: // elf
-	case 5: // hie
-	case 6: // def
-	case 7: // hef
-	case 8: // dwaf
-	case 9: // trol
-	case 10: // ogr
-	case 11: // hlf
-	case 12: // gnm
-	case 26: // frg
-	case 27: // frg
-	case 128: // isk
-	case 130: // vah
-		return false;
-	case 216: // horse
-		return true;
+void HorseRace_Record(WORD race, EQDAGINFO* dag)
+{
+	HorseRaceClassified.set(race);
+	HorseRaceIsHorse.set(race, dag != nullptr);
+	HorseRaceRiderDag[race] = dag;
+	HorseRaceClassifiedRaces.push_back(race);
+}
+
+// Classifies every unclassified race in the spawn list that has a model. Returns false if some had none yet.
+bool HorseRace_ClassifySpawns()
+{
+	bool complete = true;
+	for (EQSPAWNINFO* spawn = (EQSPAWNINFO*)EQ_OBJECT_FirstSpawn; spawn; spawn = spawn->Next) {
+		if (HorseRaceClassified.test(spawn->Race))
+			continue;
+		if (!spawn->ActorInfo || !spawn->ActorInfo->ModelInfo) {
+			complete = false;
+			continue;
+		}
+		HorseRace_Record(spawn->Race, HorseRace_LookupRiderDag(spawn));
 	}
+	return complete;
+}
 
-	auto it = is_horse_map.find(race);
-	if (it != is_horse_map.end())
-		return it->second;
+// The previous zone's models (and their DAGs) are gone, so start over and classify what's here
+void HorseRace_OnZone()
+{
+	for (WORD race : HorseRaceClassifiedRaces) {
+		HorseRaceClassified.reset(race);
+		HorseRaceIsHorse.reset(race);
+		HorseRaceRiderDag[race] = nullptr;
+	}
+	HorseRaceClassifiedRaces.clear();
+	HorseRace_Init();
+	HorseRace_Pending = true;
+	HorseRace_PendingFrames = 0;
+	HorseRace_Pulse();
+}
 
-	// Cache the result
-	bool is_horse = GetRiderDag(entity) != nullptr;
-	is_horse_map[race] = is_horse;
-	return is_horse;
+// Once a frame, while spawns with races not classified yet may be around
+void HorseRace_Pulse()
+{
+	if (!HorseRace_Pending)
+		return;
+	if (HorseRace_ClassifySpawns()) {
+		HorseRace_Pending = false;
+		HorseRace_PendingFrames = 0;
+		return;
+	}
+	if (++HorseRace_PendingFrames < kHorseRaceModelWaitFrames)
+		return;
+	// Still no model: not something that can be ridden
+	for (EQSPAWNINFO* spawn = (EQSPAWNINFO*)EQ_OBJECT_FirstSpawn; spawn; spawn = spawn->Next) {
+		if (!HorseRaceClassified.test(spawn->Race))
+			HorseRace_Record(spawn->Race, nullptr);
+	}
+	HorseRace_Pending = false;
+	HorseRace_PendingFrames = 0;
+}
+
+// The RIDER_DAG of the entity's race in this zone, or nullptr if it has none or isn't classified yet
+EQDAGINFO* GetRiderDag(EQSPAWNINFO* entity)
+{
+	if (!entity)
+		return nullptr;
+	return HorseRaceRiderDag[entity->Race];
+}
+
+// Replaced the basic EQ IsHorse() function which only checks Race == 216
+bool __fastcall IsHorse(EQSPAWNINFO* entity, int unused)
+{
+	if (!entity)
+		return false;
+	return HorseRaceIsHorse.test(entity->Race);
 }
 
 bool FakeHorseRace(EQSPAWNINFO* entity)
@@ -2115,6 +2673,7 @@ void __fastcall EQPlayer__Dismount_Detour(EQSPAWNINFO* player, int unused)
 // This needs to happen for mez effects to be able to extend themselves or apply while the player is already stunned.
 __int16 __fastcall EQCharacter__ForceStunMe(EQCHARINFO* charinfo, int unused, unsigned int duration)
 {
+	SpellAffectCache_Invalidate(); // Called from HitBySpell right after the mez buff is written
 	EQSPAWNINFO* entity = charinfo->SpawnInfo;
 	if (entity)
 	{
@@ -2163,79 +2722,163 @@ void ApplyMesmerizationFixes()
 #define EQZoneInfo_AddZoneInfo 0x00523AEB
 #define EQZoneInfo_AddZoneInfo 0x00523AEB
 
-// Define a structure to store a row of CSV data
-struct CSVRow {
-	std::vector<std::string> columns;
-};
-
-// Utility function to parse a CSV file and key rows by index
-std::vector<CSVRow> parseCSVWithIndex(const std::string& filePath) {
-	std::vector<CSVRow> data;
-	std::ifstream file(filePath);
-
-	if (!file.is_open()) {
-		return data;
-	}
-
-	std::string line;
-	while (std::getline(file, line)) {
-		CSVRow row;
-		std::stringstream lineStream(line);
-		std::string cell;
-
-		while (std::getline(lineStream, cell, '^')) {
-			row.columns.push_back(cell);
+// Parsed form of a '^'-delimited data file, where every column of a row has to be present and non-empty (other rows
+// are skipped). Cells are ints, or offsets into a string pool for the columns in 'string_columns'.
+// Parsing the text is only done when it changed: the parsed table is kept in memory, and saved next to the text file as
+// a binary snapshot (ZoneData.txt -> ZoneData.bin) that later runs load as-is while the text file's size and
+// write time still match. Any problem with the snapshot just means parsing the text again.
+class DataTable {
+public:
+	DataTable(const char* text_path, const char* snapshot_path, DWORD column_count, DWORD string_columns)
+		: text_path(text_path), snapshot_path(snapshot_path), column_count(column_count), string_columns(string_columns) {}
+
+	// Makes sure the table matches the text file. Cheap (one file stat) when nothing changed.
+	void Refresh() {
+		WIN32_FILE_ATTRIBUTE_DATA attributes;
+		if (!GetFileAttributesExA(text_path, GetFileExInfoStandard, &attributes)) {
+			Clear(); // No text file, no data (same as before there was a snapshot)
+			return;
 		}
+		ULONGLONG write_time = ((ULONGLONG)attributes.ftLastWriteTime.dwHighDateTime << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+		if (loaded && write_time == source_write_time && attributes.nFileSizeLow == source_size)
+			return;
+		source_write_time = write_time;
+		source_size = attributes.nFileSizeLow;
+		if (!LoadSnapshot()) {
+			ParseText();
+			SaveSnapshot();
+		}
+		loaded = true;
+	}
+
+	size_t RowCount() const { return column_count ? cells.size() / column_count : 0; }
+	int GetInt(size_t row, size_t column) const { return cells[row * column_count + column]; }
+	const char* GetString(size_t row, size_t column) const { return &strings[cells[row * column_count + column]]; }
+
+private:
+	static constexpr DWORD SNAPSHOT_MAGIC = 0x54415145; // "EQAT"
+	static constexpr DWORD SNAPSHOT_VERSION = 1;
+	struct SnapshotHeader {
+		DWORD magic;
+		DWORD version;
+		ULONGLONG source_write_time;
+		DWORD source_size;
+		DWORD column_count;
+		DWORD string_columns;
+		DWORD row_count;
+		DWORD string_pool_size;
+	};
+
+	bool IsStringColumn(size_t column) const { return (string_columns >> column) & 1; }
+
+	void Clear() {
+		cells.clear();
+		strings.clear();
+		loaded = false;
+	}
+
+	void ParseText() {
+		cells.clear();
+		strings.clear();
+		DelimitedFile text(text_path);
+		text.ForEachRow([this](const DelimitedField* column, size_t count) {
+			if (count != column_count)
+				return;
+			for (size_t i = 0; i < count; i++) {
+				if (column[i].empty())
+					return;
+			}
+			for (size_t i = 0; i < count; i++) {
+				if (IsStringColumn(i)) {
+					cells.push_back((int)strings.size());
+					strings.insert(strings.end(), column[i].text, column[i].text + column[i].length);
+					strings.push_back('\0');
+				}
+				else {
+					cells.push_back(column[i].ToInt());
+				}
+			}
+		});
+	}
+
+	bool LoadSnapshot() {
+		HANDLE file = CreateFileA(snapshot_path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+		SnapshotHeader header;
+		DWORD read = 0;
+		bool ok = ReadFile(file, &header, sizeof(header), &read, NULL) && read == sizeof(header)
+			&& header.magic == SNAPSHOT_MAGIC && header.version == SNAPSHOT_VERSION
+			&& header.source_write_time == source_write_time && header.source_size == source_size
+			&& header.column_count == column_count && header.string_columns == string_columns
+			&& header.row_count < 0x100000 && header.string_pool_size < 0x1000000
+			&& GetFileSize(file, NULL) == sizeof(header) + header.row_count * column_count * sizeof(int) + header.string_pool_size;
+		if (ok) {
+			cells.resize(header.row_count * column_count);
+			strings.resize(header.string_pool_size);
+			DWORD cells_size = (DWORD)(cells.size() * sizeof(int));
+			ok = (cells.empty() || (ReadFile(file, cells.data(), cells_size, &read, NULL) && read == cells_size))
+				&& (strings.empty() || (ReadFile(file, strings.data(), header.string_pool_size, &read, NULL) && read == header.string_pool_size))
+				&& (strings.empty() || strings.back() == '\0');
+			for (size_t i = 0; ok && i < cells.size(); i++) {
+				if (IsStringColumn(i % column_count) && (DWORD)cells[i] >= header.string_pool_size)
+					ok = false; // Would point outside the pool
+			}
+		}
+		CloseHandle(file);
+		if (!ok) {
+			cells.clear();
+			strings.clear();
+		}
+		return ok;
+	}
+
+	void SaveSnapshot() const {
+		SnapshotHeader header = { SNAPSHOT_MAGIC, SNAPSHOT_VERSION, source_write_time, source_size, column_count, string_columns,
+			(DWORD)RowCount(), (DWORD)strings.size() };
+		std::string temp_path = std::string(snapshot_path) + ".tmp";
+		HANDLE file = CreateFileA(temp_path.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (file == INVALID_HANDLE_VALUE)
+			return; // Read-only folder etc, we'll just parse the text next time
+		DWORD written = 0;
+		DWORD cells_size = (DWORD)(cells.size() * sizeof(int));
+		bool ok = WriteFile(file, &header, sizeof(header), &written, NULL) && written == sizeof(header)
+			&& (cells.empty() || (WriteFile(file, cells.data(), cells_size, &written, NULL) && written == cells_size))
+			&& (strings.empty() || (WriteFile(file, strings.data(), (DWORD)strings.size(), &written, NULL) && written == strings.size()));
+		CloseHandle(file);
+		if (!ok || !MoveFileExA(temp_path.c_str(), snapshot_path, MOVEFILE_REPLACE_EXISTING))
+			DeleteFileA(temp_path.c_str());
+	}
+
+	const char* text_path;
+	const char* snapshot_path;
+	DWORD column_count;
+	DWORD string_columns; // Bit i set = column i is a string
+	bool loaded = false;
+	ULONGLONG source_write_time = 0;
+	DWORD source_size = 0;
+	std::vector<int> cells; // Row-major
+	std::vector<char> strings;
+};
 
-		data.push_back(row);
-	}
-
-	file.close();
-	return data;
-}
-
+// ZoneData.txt: id^short name^long name^unk^unk2^unk3^unk4
+enum ZoneDataColumn { ZoneData_Id, ZoneData_ShortName, ZoneData_LongName, ZoneData_Unk, ZoneData_Unk2, ZoneData_Unk3, ZoneData_Unk4, ZoneData_Count };
+DataTable ZoneDataTable("ZoneData.txt", "ZoneData.bin", ZoneData_Count, (1 << ZoneData_ShortName) | (1 << ZoneData_LongName));
 
+// RaceData.txt: race id^gender^actor tag
+enum RaceDataColumn { RaceData_Race, RaceData_Gender, RaceData_Code, RaceData_Count };
+DataTable RaceDataTable("RaceData.txt", "RaceData.bin", RaceData_Count, 1 << RaceData_Code);
 
 typedef int(__thiscall* EQ_FUNCTION_TYPE_EQZoneInfo__EQZoneInfo)(void* this_ptr);
 EQ_FUNCTION_TYPE_EQZoneInfo__EQZoneInfo EQZoneInfo_Ctor_Trampoline;
 int __fastcall EQZoneInfo_Ctor_Detour(void* this_ptr, void* not_used) {
 	int ctor_result = EQZoneInfo_Ctor_Trampoline(this_ptr);
 
-	auto data = parseCSVWithIndex("ZoneData.txt");
-
-	if (data.size())
-	{
-		for (auto& entry : data)
-		{
-			std::vector<std::string>& column = entry.columns;
-			if (column.size() == 7)
-			{
-				if (column[0].empty())
-					continue;
-				else if (column[1].empty())
-					continue;
-				else if (column[2].empty())
-					continue;
-				else if (column[3].empty())
-					continue;
-				else if (column[4].empty())
-					continue;
-				else if (column[5].empty())
-					continue;
-				else if (column[6].empty())
-					continue;
-
-				unsigned int zoneIdNum = std::atoi(column[0].c_str());
-				const char* zoneShortName = column[1].c_str();
-				const char* zoneLongName = column[2].c_str();
-				unsigned int zoneUnk = std::atoi(column[3].c_str());
-				unsigned int zoneUnk2 = std::atoi(column[4].c_str());
-				unsigned int zoneUnk3 = std::atoi(column[5].c_str());
-				unsigned int zoneUnk4 = std::atoi(column[6].c_str());
-
-				((int(__thiscall*) (LPVOID, int, int, const char*, const char*, int, unsigned long, int, int)) EQZoneInfo_AddZoneInfo) (this_ptr, 0, zoneIdNum, zoneShortName, zoneLongName, zoneUnk, zoneUnk2, zoneUnk3, zoneUnk4);
-			}
-		}
+	ZoneDataTable.Refresh();
+	for (size_t row = 0; row < ZoneDataTable.RowCount(); row++) {
+		((int(__thiscall*) (LPVOID, int, int, const char*, const char*, int, unsigned long, int, int)) EQZoneInfo_AddZoneInfo) (this_ptr, 0,
+			ZoneDataTable.GetInt(row, ZoneData_Id), ZoneDataTable.GetString(row, ZoneData_ShortName), ZoneDataTable.GetString(row, ZoneData_LongName),
+			ZoneDataTable.GetInt(row, ZoneData_Unk), ZoneDataTable.GetInt(row, ZoneData_Unk2), ZoneDataTable.GetInt(row, ZoneData_Unk3), ZoneDataTable.GetInt(row, ZoneData_Unk4));
 	}
 
 	/*((int(__thiscall*) (LPVOID, int, int, const char*, const char*, int, unsigned long, int, int)) EQZoneInfo_AddZoneInfo) (this_ptr, 0, 224, "gunthak", "Gulf of Gunthak", 4048, 4, 0, 0);
@@ -2294,17 +2937,24 @@ std::vector<std::pair<std::string, std::string>> readChrTextFile(const std::stri
 //	}
 //}
 
-struct RaceData {
-	BYTE gender = 0;
-	std::string code;
-};
+// Actor tag overrides from RaceData.txt, indexed directly by race and gender (0 male, 1 female, 2 neuter).
+// Tags are up to 3 characters, stored NUL-terminated in 4 bytes; an empty tag means no override.
+constexpr size_t MAX_ACTOR_TAG_RACES = 1024;
+constexpr size_t MAX_ACTOR_TAG_GENDERS = 3;
+char ActorTagTable[MAX_ACTOR_TAG_RACES][MAX_ACTOR_TAG_GENDERS][4];
 
-std::map<unsigned int, RaceData> raceIdToCodeMap;
+inline const char* GetActorTagOverride(WORD race, BYTE gender)
+{
+	if (race >= MAX_ACTOR_TAG_RACES || gender >= MAX_ACTOR_TAG_GENDERS || !ActorTagTable[race][gender][0])
+		return nullptr;
+	return ActorTagTable[race][gender];
+}
 
 typedef int(__thiscall* EQ_FUNCTION_TYPE_EQPlayer_GetActorTag)(EQSPAWNINFO* this_ptr, char* a2);
 EQ_FUNCTION_TYPE_EQPlayer_GetActorTag EQPlayer_GetActorTag_Trampoline;
 int __fastcall EQPlayer_GetActorTag_Detour(EQSPAWNINFO* this_ptr, void* not_used, char* a2) {
 
+	DeferredInit_Wait(); // ActorTagTable
 	WORD ourRace = this_ptr->Race;
 	BYTE ourGender = this_ptr->Gender;
 
@@ -2317,14 +2967,9 @@ int __fastcall EQPlayer_GetActorTag_Detour(EQSPAWNINFO* this_ptr, void* not_used
 	// Restore the horse to race 216
 	this_ptr->Race = ourRace;	
 
-	std::map<unsigned int, RaceData>::iterator it = raceIdToCodeMap.find(ourRace);
-	if (it != raceIdToCodeMap.end())
-	{
-		if (it->second.gender == ourGender)
-		{
-			strcpy(a2, it->second.code.c_str());
-		}
-	}
+	const char* tag = GetActorTagOverride(ourRace, ourGender);
+	if (tag)
+		memcpy(a2, tag, 4);
 	return res;
 }
 
@@ -2408,7 +3053,7 @@ int __cdecl ProcessKeyDown_Detour(int a1)
 			char szDefault[255];
 
 			sprintf(szDefault, "%s", "FALSE");
-			WritePrivateProfileStringA_tramp("Options", "WindowedMode", szDefault, "./eqclient.ini");
+			IniStore_Set("Options", "WindowedMode", szDefault);
 			start_fullscreen = true;
 			first_maximize = false;
 		}
@@ -2427,7 +3072,7 @@ int __cdecl ProcessKeyDown_Detour(int a1)
 			}
 			char szDefault[255];
 			sprintf(szDefault, "%s", "TRUE");
-			WritePrivateProfileStringA_tramp("Options", "WindowedMode", szDefault, "./eqclient.ini");
+			IniStore_Set("Options", "WindowedMode", szDefault);
 			start_fullscreen = false;
 		}
 		bWindowedMode = !bWindowedMode;
@@ -2467,8 +3112,13 @@ DWORD WINAPI WritePrivateProfileStringA_detour(LPCSTR lpAppName, LPCSTR lpKeyNam
 		}
 		if (!bWindowedMode)
 			return true;
+		if (lpKeyName && lpString && lpFileName) {
+			IniStore_QueuePosition(lpAppName, lpKeyName, lpString, lpFileName); // Written once the window settles (IniStore_Pulse)
+			return true;
+		}
 	}
 	DWORD ret = WritePrivateProfileStringA_tramp(lpAppName, lpKeyName, lpString, lpFileName);
+	IniStore_Mirror(lpAppName, lpKeyName, lpString, lpFileName);
 	
 	if (lstrcmp(lpAppName, "VideoMode") == 0) {
 		if (lstrcmp(lpKeyName, "Height") == 0) {
@@ -2662,33 +3312,22 @@ signed int __cdecl ProcessMouseEvent_Hook()
 
 void InitRaceShortCodeMap()
 {
-	raceIdToCodeMap.clear();
-	auto parsedMap = parseCSVWithIndex("RaceData.txt");
-	if (parsedMap.size())
-	{
-		for (auto& entry : parsedMap)
-		{
-			std::vector<std::string>& column = entry.columns;
-			if (column.size() == 3)
-			{
-				if (column[0].empty())
-					continue;
-				else if (column[1].empty())
-					continue;
-				else if (column[2].empty())
-					continue;
-
-				unsigned int raceIdNum = std::atoi(column[0].c_str());
-				unsigned int genderIdNum = std::atoi(column[1].c_str());
-				std::string raceCodeId = column[2];
-
-				RaceData rData;
-				rData.gender = genderIdNum;
-				rData.code = raceCodeId;
-
-				raceIdToCodeMap.emplace(raceIdNum, rData);
-			}
+	memset(ActorTagTable, 0, sizeof(ActorTagTable));
+	RaceDataTable.Refresh();
+	for (size_t row = 0; row < RaceDataTable.RowCount(); row++) {
+		int race = RaceDataTable.GetInt(row, RaceData_Race);
+		int gender = RaceDataTable.GetInt(row, RaceData_Gender);
+		const char* code = RaceDataTable.GetString(row, RaceData_Code);
+		if (race < 0 || (size_t)race >= MAX_ACTOR_TAG_RACES || gender < 0 || (size_t)gender >= MAX_ACTOR_TAG_GENDERS || strlen(code) > 3) {
+#ifdef LOGGING
+			WriteLog("InitRaceShortCodeMap: Skipping RaceData.txt row for race " + std::to_string(race) + ", gender " + std::to_string(gender) + ", tag '" + code + "'");
+#endif
+			continue;
 		}
+
+		char* tag = ActorTagTable[race][gender];
+		if (!tag[0]) // First row for a race/gender wins
+			strcpy_s(tag, 4, code);
 	}
 }
 
@@ -2711,6 +3350,7 @@ void InitRaceShortCodeMap()
 	return retval;
 }*/
 extern void LoadIniSettings();
+void SpellAffectCache_ToggleVerify();
 
 int __fastcall EQMACMQ_DETOUR_CEverQuest__InterpretCmd(void* this_ptr, void* not_used, class EQPlayer* a1, char* a2)
 {
@@ -2747,13 +3387,24 @@ int __fastcall EQMACMQ_DETOUR_CEverQuest__InterpretCmd(void* this_ptr, void* not
 	}
 
 	if (strcmp(a2, "/rnpcdata") == 0) {
+		DeferredInit_Wait();
 		InitRaceShortCodeMap();
 		return EQMACMQ_REAL_CEverQuest__InterpretCmd(this_ptr, NULL, NULL);
 	}
 
+	if (strcmp(a2, "/startup") == 0) {
+		StartupProfile_Print(true);
+		return EQMACMQ_REAL_CEverQuest__InterpretCmd(this_ptr, NULL, NULL);
+	}
+
+	if (strcmp(a2, "/spacheck") == 0) {
+		SpellAffectCache_ToggleVerify();
+		return EQMACMQ_REAL_CEverQuest__InterpretCmd(this_ptr, NULL, NULL);
+	}
+
 	if (strcmp(a2, "/songs") == 0) {
 		g_bSongWindowAutoHide = !g_bSongWindowAutoHide;
-		WritePrivateProfileStringA_tramp("Defaults", "SongWindowAutoHide", g_bSongWindowAutoHide ? "TRUE" : "FALSE", "./eqclient.ini");
+		IniStore_Set("Defaults", "SongWindowAutoHide", g_bSongWindowAutoHide ? "TRUE" : "FALSE");
 		print_chat("Song Window auto-hide: %s.", g_bSongWindowAutoHide ? "ON" : "OFF");
 		if (!g_bSongWindowAutoHide && GetShortDurationBuffWindow() && !GetShortDurationBuffWindow()->IsVisibile()) {
 			GetShortDurationBuffWindow()->Show(1, 1);
@@ -2881,8 +3532,9 @@ constexpr WORD BSP_VERSION_1 = 1; // Buff Stacking feature flag sent to the serv
 
 // Short Buff Window
 CShortBuffWindow* ShortBuffWindow = nullptr;
-// Set during ShortBuffWindow's refresh logic, so it reads from offset 15 (because it shares logic with CBuffWindow)
-thread_local bool ShortBuffSupport_ReturnSongBuffs = false;
+// Set during ShortBuffWindow's refresh logic, so it reads from offset 15 (because it shares logic with CBuffWindow).
+// Changed only through ScopedBuffView (buff_view.h).
+BuffView CurrentBuffView = { nullptr, false };
 
 // -- [Handshake / Initialization] --
 
@@ -3368,6 +4020,7 @@ RETURN_RESULT_SLOTNUM_194:
 typedef _EQBUFFINFO* (__thiscall* EQ_FUNCTION_TYPE_EQCharacter__FindAffectSlot)(EQCHARINFO* this_ptr, WORD spellid, _EQSPAWNINFO* caster, DWORD* out_slot, int flag);
 EQ_FUNCTION_TYPE_EQCharacter__FindAffectSlot EQCharacter__FindAffectSlot_Trampoline;
 _EQBUFFINFO* __fastcall EQCharacter__FindAffectSlot_Detour(EQCHARINFO* player, int unused, WORD spellid, _EQSPAWNINFO* caster, DWORD* out_slot, int flag) {
+	SpellAffectCacheWriteScope spell_affect_cache_scope; // May remove a buff, and the caller writes the new one into the returned slot
 	if (Rule_Buffstacking_Patch_Enabled) {
 		return BSP_FindAffectSlot(player, spellid, caster, out_slot, flag);
 	}
@@ -3381,9 +4034,6 @@ _EQBUFFINFO* __fastcall EQCharacter__FindAffectSlot_Detour(EQCHARINFO* player, i
 _EQBUFFINFO* GetStartBuffArray(bool song_buffs) {
 	return song_buffs ? EQ_OBJECT_CharInfo->BuffsExt : EQ_OBJECT_CharInfo->Buff;
 }
-void MakeGetBuffReturnSongs(bool enabled) {
-	ShortBuffSupport_ReturnSongBuffs = enabled;
-}
 
 // MaxBuffs is now increased when enabled (Rule_Max_Buffs)
 typedef int(__thiscall* EQ_FUNCTION_TYPE_EQCharacter__GetMaxBuffs)(EQCHARINFO* this_ptr);
@@ -3406,12 +4056,172 @@ int __fastcall EQCHARACTER__GetMaxBuffs_Detour(EQCHARINFO* player, int unused)
 typedef _EQBUFFINFO* (__thiscall* EQ_FUNCTION_TYPE_EQCharacter__GetBuff)(EQCHARINFO* this_char_info, int buff_slot);
 EQ_FUNCTION_TYPE_EQCharacter__GetBuff EQCharacter__GetBuff_Trampoline;
 _EQBUFFINFO* __fastcall EQCharacter__GetBuff_Detour(EQCHARINFO* player, int unused, WORD buff_slot) {
-	if (ShortBuffSupport_ReturnSongBuffs && buff_slot < 15) {
+	if (CurrentBuffView.song_buffs && buff_slot < 15) {
 		buff_slot += 15;
 	}
 	return EQCharacter__GetBuff_Trampoline(player, buff_slot);
 }
 
+// ---------------------------------------------------------
+// Spell Affect Cache
+// ---------------------------------------------------------
+
+// EQ_Character::TotalSpellAffects(spa, flag, per_buff_values) walks every buff slot (up to Rule_Max_Buffs) and evaluates
+// each spell's 12 effects, and the stat code calls it for many SPAs per frame. The totals are cached per character and
+// per (spa, flag), and are thrown away as soon as anything they could depend on changes: the raw buff slots (spell,
+// caster level, modifier, ticks, counters), the slot count, the character's level and the worn item pointers.
+// The client has no single add/remove/tick path to hook (OP_Buff, FindAffectSlot, RemoveBuff and the tick all write the
+// slots directly), so the buff slots are snapshotted and compared instead of being tracked incrementally.
+// That comparison is O(slots), so it runs at most once per generation, and in between a hit is one generation compare.
+// The generation moves (SpellAffectCache_Invalidate) on every frame, before and after every world message and outgoing
+// message, around FindAffectSlot (and the RemoveBuff calls it makes) and the buff window's click-off, and when a mez
+// lands (ForceStunMe). The client's buff tick isn't hooked, so a buff it wears off is picked up on the next frame.
+// SpellAffectCache_ToggleVerify recomputes every hit through the client and counts mismatches.
+// Calls that ask for per_buff_values always go to the client.
+
+#define SPELL_AFFECT_CACHE_CHARACTERS 4
+#define SPELL_AFFECT_CACHE_MAX_BUFFS 30
+
+struct SpellAffectCacheEntry
+{
+	EQCHARINFO* charinfo;
+	DWORD generation; // SpellAffectCache_Generation the entry was last validated in, 0 = never
+	int max_buffs;
+	WORD level;
+	EQITEMINFO* worn[EQ_NUM_INVENTORY_SLOTS];
+	EQBUFFINFO buffs[SPELL_AFFECT_CACHE_MAX_BUFFS];
+	std::bitset<512> valid; // (spa << 1) | (flag != 0)
+	__int16 total[512];
+};
+
+SpellAffectCacheEntry SpellAffectCache[SPELL_AFFECT_CACHE_CHARACTERS];
+int SpellAffectCache_NextVictim = 0;
+DWORD SpellAffectCache_Generation = 1;
+bool SpellAffectCache_Verify = false;
+DWORD SpellAffectCache_Hits = 0;
+DWORD SpellAffectCache_Misses = 0;
+DWORD SpellAffectCache_Mismatches = 0;
+DWORD SpellAffectCache_Validations = 0;
+LONGLONG SpellAffectCache_ValidateTicks = 0; // QueryPerformanceCounter ticks spent snapshotting and comparing
+LONGLONG SpellAffectCache_MissTicks = 0; // QueryPerformanceCounter ticks the client spent on misses
+
+void SpellAffectCache_Invalidate()
+{
+	if (++SpellAffectCache_Generation == 0)
+		SpellAffectCache_Generation = 1;
+}
+
+typedef __int16(__thiscall* EQ_FUNCTION_TYPE_EQCharacter__TotalSpellAffects)(EQCHARINFO* this_ptr, BYTE affect_type, char a3, int* per_buff_values);
+EQ_FUNCTION_TYPE_EQCharacter__TotalSpellAffects EQCharacter__TotalSpellAffects_Trampoline;
+
+// Returns the cache entry for this character, with its totals cleared if the state they were computed from has changed.
+SpellAffectCacheEntry* SpellAffectCache_Get(EQCHARINFO* player)
+{
+	SpellAffectCacheEntry* entry = NULL;
+	for (int i = 0; i < SPELL_AFFECT_CACHE_CHARACTERS; i++) {
+		if (SpellAffectCache[i].charinfo == player) {
+			entry = &SpellAffectCache[i];
+			break;
+		}
+	}
+	if (entry && entry->generation == SpellAffectCache_Generation)
+		return entry; // Already validated this generation
+
+	LARGE_INTEGER start, end;
+	QueryPerformanceCounter(&start);
+	int max_buffs = EQCHARACTER__GetMaxBuffs_Detour(player, 0);
+	if (max_buffs > SPELL_AFFECT_CACHE_MAX_BUFFS)
+		return NULL;
+
+	EQBUFFINFO buffs[SPELL_AFFECT_CACHE_MAX_BUFFS];
+	for (int i = 0; i < max_buffs; i++) {
+		buffs[i] = *EQ_Character::GetBuff(player, i);
+	}
+
+	if (!entry) {
+		entry = &SpellAffectCache[SpellAffectCache_NextVictim];
+		SpellAffectCache_NextVictim = (SpellAffectCache_NextVictim + 1) % SPELL_AFFECT_CACHE_CHARACTERS;
+		entry->charinfo = player;
+		entry->max_buffs = -1;
+	}
+
+	if (entry->max_buffs != max_buffs
+		|| entry->level != player->Level
+		|| memcmp(entry->worn, player->InventoryItem, sizeof(entry->worn)) != 0
+		|| memcmp(entry->buffs, buffs, max_buffs * sizeof(EQBUFFINFO)) != 0) {
+		entry->max_buffs = max_buffs;
+		entry->level = player->Level;
+		memcpy(entry->worn, player->InventoryItem, sizeof(entry->worn));
+		memcpy(entry->buffs, buffs, max_buffs * sizeof(EQBUFFINFO));
+		entry->valid.reset();
+	}
+	entry->generation = SpellAffectCache_Generation;
+	QueryPerformanceCounter(&end);
+	SpellAffectCache_Validations++;
+	SpellAffectCache_ValidateTicks += end.QuadPart - start.QuadPart;
+	return entry;
+}
+
+__int16 __fastcall EQCharacter__TotalSpellAffects_Detour(EQCHARINFO* player, int unused, BYTE affect_type, char a3, int* per_buff_values)
+{
+	// The song window's GetBuff redirect changes what the client would read, so leave those calls alone too.
+	if (!player || per_buff_values || CurrentBuffView.song_buffs)
+		return EQCharacter__TotalSpellAffects_Trampoline(player, affect_type, a3, per_buff_values);
+
+	SpellAffectCacheEntry* entry = SpellAffectCache_Get(player);
+	if (!entry)
+		return EQCharacter__TotalSpellAffects_Trampoline(player, affect_type, a3, per_buff_values);
+
+	int key = (affect_type << 1) | (a3 != 0);
+	if (!entry->valid[key]) {
+		SpellAffectCache_Misses++;
+		LARGE_INTEGER start, end;
+		QueryPerformanceCounter(&start);
+		entry->total[key] = EQCharacter__TotalSpellAffects_Trampoline(player, affect_type, a3, NULL);
+		QueryPerformanceCounter(&end);
+		SpellAffectCache_MissTicks += end.QuadPart - start.QuadPart;
+		entry->valid[key] = true;
+		return entry->total[key];
+	}
+
+	SpellAffectCache_Hits++;
+	if (SpellAffectCache_Verify) {
+		__int16 expected = EQCharacter__TotalSpellAffects_Trampoline(player, affect_type, a3, NULL);
+		if (expected != entry->total[key]) {
+			SpellAffectCache_Mismatches++;
+			print_chat("Spell affect cache mismatch: SPA %d (flag %d) cached %d, client %d.", affect_type, a3, entry->total[key], expected);
+			entry->total[key] = expected;
+		}
+	}
+	return entry->total[key];
+}
+
+void SpellAffectCache_Reset()
+{
+	for (int i = 0; i < SPELL_AFFECT_CACHE_CHARACTERS; i++) {
+		SpellAffectCache[i].charinfo = NULL;
+		SpellAffectCache[i].generation = 0;
+		SpellAffectCache[i].valid.reset();
+	}
+}
+
+// Also reports whether the cache pays for itself: a hit saves about one average miss (the client's own time), and the
+// cost is the validations. The hit path itself (a pointer scan and a compare) isn't timed.
+void SpellAffectCache_ToggleVerify()
+{
+	SpellAffectCache_Verify = !SpellAffectCache_Verify;
+	print_chat("Spell affect cache verify: %s (%u hits, %u misses, %u mismatches, %u validations).", SpellAffectCache_Verify ? "ON" : "OFF",
+		SpellAffectCache_Hits, SpellAffectCache_Misses, SpellAffectCache_Mismatches, SpellAffectCache_Validations);
+
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	double ms_per_tick = 1000.0 / frequency.QuadPart;
+	double miss_ms = SpellAffectCache_MissTicks * ms_per_tick;
+	double saved_ms = SpellAffectCache_Misses ? miss_ms / SpellAffectCache_Misses * SpellAffectCache_Hits : 0.0;
+	double validate_ms = SpellAffectCache_ValidateTicks * ms_per_tick;
+	print_chat("Spell affect cache: ~%.2f ms saved on hits, %.2f ms spent validating, %.2f ms in the client on misses.", saved_ms, validate_ms, miss_ms);
+}
+
 // Hook that removes buffs or shows spell info when clicking the song window, and shows tooltips on mouseover
 int __fastcall CBuffWindow__WndNotification_Detour(CBuffWindow* self, int unused, PEQCBUFFBUTTONWND sender, int type, int a4)
 {
@@ -3425,17 +4235,20 @@ int __fastcall CBuffWindow__WndNotification_Detour(CBuffWindow* self, int unused
 		if (type != 23 && type != 25)
 			return CSidlScreenWnd::WndNotification(self, sender, type, a4);
 	LABEL_11:
-		MakeGetBuffReturnSongs(is_song_window);
-		self->HandleSpellInfoDisplay(sender);
-		MakeGetBuffReturnSongs(false);
+		{
+			ScopedBuffView view(self, is_song_window);
+			self->HandleSpellInfoDisplay(sender);
+		}
 		return CSidlScreenWnd::WndNotification(self, sender, type, a4);
 	}
 	if (AltPressed())
 		goto LABEL_11;
 	for (int i = 0; i < EQ_NUM_BUFFS; i++) {
 		if (self->Data.BuffButtonWnd[i] == sender) {
-			if (EQ_Character::IsValidAffect(EQ_OBJECT_CharInfo, i + start_buff_index))
+			if (EQ_Character::IsValidAffect(EQ_OBJECT_CharInfo, i + start_buff_index)) {
+				SpellAffectCacheWriteScope spell_affect_cache_scope;
 				EQ_Character::RemoveMyAffect(EQ_OBJECT_CharInfo, i + start_buff_index);
+			}
 			return CSidlScreenWnd::WndNotification(self, sender, type, a4);
 		}
 	}
@@ -3513,12 +4326,7 @@ constexpr BYTE kMaterialSlotHead = 0;
 constexpr BYTE kMaterialSlotPrimary = 7;
 constexpr BYTE kMaterialSlotSecondary = 8; // Shared with 'ranged'
 
-constexpr WORD kMaterialNone = 0;
-constexpr WORD kMaterialLeather = 1;
-constexpr WORD kMaterialChain = 2;
-constexpr WORD kMaterialPlate = 3;
-constexpr WORD kMaterialVeliousHelm = 240;
-constexpr WORD kMaterialVeliousHelmAlternate = 241; // A couple races support alternate helms
+// Material values (kMaterialLeather, kMaterialVeliousHelm, ...) and the helm tables are in helm_material.h
 
 // We install 'Bald' variation of heads with ID 05: "{racetag}HE05_DMSPRITEDEF". We swap to this head only when wearing a Velious Helm, to ensure hair clipping is fixed.
 constexpr WORD kMaterialBaldHead = 5;
@@ -3532,8 +4340,6 @@ constexpr char kDarkElfFemaleBaldHead[] = "DAFHE05_DMSPRITEDEF"; // todo
 constexpr DWORD kColorNone = 0;
 constexpr DWORD kColorDefault = 0x00FFFFFF;
 
-BYTE BYTE_BALD_HEAD[1] = { kMaterialBaldHead };
-BYTE BYTE_NORMAL_HEAD[1] = { (BYTE)kMaterialNone };
 
 DWORD block_outbound_wearchange = 0;
 
@@ -3545,74 +4351,12 @@ bool UseEruditeFemaleFix = false;
 bool UseWoodElfFemaleFix = false;
 bool UseDarkElfFemaleFix = false;
 
-// Helper function. Converts Velious Helms to their common values.
-// We only send the canonical values to the server and other players.
-// - [5xx/6xx] -> [240] Swaps our racial Velious head model IT### back to the generic '240' value used by all Velious helms.
-WORD ToCanonicalHelmMaterial(WORD material, WORD race)
-{
-	if ((race >= 1 && race <= 12) || race == 128 || race == 130)
-	{
-		switch (material)
-		{
-			// Vah Shir have their own material IDs when they equip leather/chain/plate helms, but no custom helm.
-		case 661: // VAH (F) Leather Helm
-		case 666: // VAH (M) Leather Helm
-			return kMaterialLeather; // (1)
-		case 662: // VAH (F) Chain Helm
-		case 667: // VAH (M) Chain Helm
-			return kMaterialChain; // (2)
-		case 663: // VAH (F) Plate Helm
-		case 668: // VAH (M) Plate Helm
-			return kMaterialPlate; // (3)
-
-			// Converts all the race-specific Velious Helm IT### numbers to the common 240 value
-		case 665: // vah
-		case 660: // vah
-		case 627: // hum
-		case 620: // hum
-		case 537: // bar
-		case 530: // bar
-		case 570: // eru
-		case 575: // eru
-		case 565: // elf
-		case 561: // elf
-		case 605: // hie
-		case 600: // hie
-		case 545: // def
-		case 540: // def
-		case 595: // hef
-		case 590: // hef
-		case 557: // dwf
-		case 550: // dwf
-		case 655: // trl
-		case 650: // trl
-		case 645: // ogr
-		case 640: // ogr
-		case 615: // hlf
-		case 610: // hlf
-		case 585: // gnm
-		case 580: // gnm
-		case 635: // iks
-		case 630: // iks
-			if (race == 130) // vah
-				return kMaterialPlate;
-			return kMaterialVeliousHelm;
-		case 641: // OGR (F) Alternate Helm (Barbarian/RZ look)
-		case 646: // OGR (M) Alternate Helm (Barbarian/RZ look)
-			if (race == 10) // ogre
-				return kMaterialVeliousHelmAlternate;
-			return kMaterialVeliousHelm;
-		}
-	}
-	return material;
-}
-
 bool HelmHelperIsEnabled(char* key)
 {
 	char szResult[255];
 	char szDefault[255];
 	sprintf(szDefault, "%s", "FALSE");
-	DWORD error = GetPrivateProfileStringA("Defaults", key, szDefault, szResult, 255, "./eqclient.ini");
+	IniStore_Get("Defaults", key, szDefault, szResult, sizeof(szResult));
 	if (strcmp(szResult, "TRUE") == 0)
 		return true;
 	return false;
@@ -3683,6 +4427,70 @@ bool IsHelmPatchedOldModel(WORD race, BYTE gender)
 	return false;
 }
 
+// SwapHead() picks the default head with a 'push 0' (6A 00) at 0x4A1C65. At startup that push, plus the whole
+// instructions after it that the 5-byte jmp overwrites, is replaced once with a jmp to a thunk built here: it pushes
+// SwapHead_DefaultHead, replays the moved instructions (relocated by DetourCopyInstruction) and jumps back. After that
+// SwapHead_Detour only sets the variable, the code is never patched again.
+constexpr uintptr_t kSwapHeadDefaultHeadPush = 0x4A1C65;
+constexpr size_t kSwapHeadDefaultHeadPushSize = 2;
+constexpr size_t kSwapHeadThunkSize = 64;
+DWORD SwapHead_DefaultHead = kMaterialNone;
+BYTE* SwapHead_DefaultHeadThunk = nullptr; // Set once the jmp is in, the bald head fix is off without it
+PatchTransaction SwapHead_DefaultHeadPatch;
+
+void InstallSwapHeadDefaultHeadThunk()
+{
+	BYTE* push_inst = (BYTE*)kSwapHeadDefaultHeadPush;
+	if (push_inst[0] != 0x6A || push_inst[1] != (BYTE)kMaterialNone)
+	{
+#ifdef LOGGING
+		WriteLog("InstallSwapHeadDefaultHeadThunk: Unexpected instruction at 0x4A1C65, bald head helm fix disabled.");
+#endif
+		return;
+	}
+
+	BYTE* thunk = (BYTE*)VirtualAlloc(nullptr, kSwapHeadThunkSize, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+	if (!thunk)
+		return;
+	BYTE* out = thunk;
+	*out++ = 0xFF; // push dword ptr [SwapHead_DefaultHead], replaces 'push 0' (no registers or flags touched)
+	*out++ = 0x35;
+	*(DWORD**)out = &SwapHead_DefaultHead;
+	out += 4;
+
+	// Move whole instructions until the jmp fits. Branches aren't moved (their length can change when relocated).
+	BYTE* moved = push_inst + kSwapHeadDefaultHeadPushSize;
+	while (moved < push_inst + 5) {
+		PBYTE target = nullptr;
+		BYTE* next = DetourCopyInstruction(out, moved, &target);
+		if (!next || target || next - moved > 15)
+		{
+#ifdef LOGGING
+			WriteLog("InstallSwapHeadDefaultHeadThunk: Can't move the instructions after 0x4A1C65, bald head helm fix disabled.");
+#endif
+			VirtualFree(thunk, 0, MEM_RELEASE);
+			return;
+		}
+		out += next - moved;
+		moved = next;
+	}
+	*out++ = 0xE9; // jmp back past the moved instructions
+	*(uintptr_t*)out = (uintptr_t)moved - ((uintptr_t)out + 4);
+	out += 4;
+	FlushInstructionCache(GetCurrentProcess(), thunk, out - thunk);
+
+	BYTE jmp_inst[5] = { 0xE9 };
+	*(uintptr_t*)&jmp_inst[1] = (uintptr_t)thunk - (kSwapHeadDefaultHeadPush + 5);
+	SwapHead_DefaultHeadPatch.Write(kSwapHeadDefaultHeadPush, jmp_inst, sizeof(jmp_inst));
+	SwapHead_DefaultHeadPatch.Nop(kSwapHeadDefaultHeadPush + 5, (uintptr_t)moved);
+	if (!SwapHead_DefaultHeadPatch.Commit())
+	{
+		VirtualFree(thunk, 0, MEM_RELEASE);
+		return;
+	}
+	SwapHead_DefaultHeadThunk = thunk;
+}
+
 typedef int(__thiscall* EQ_FUNCTION_TYPE_SwapHead)(int* cDisplay, EQSPAWNINFO* entity, int new_material, int old_material, DWORD color, bool from_server);
 EQ_FUNCTION_TYPE_SwapHead SwapHead_Trampoline;
 int __fastcall SwapHead_Detour(int* cDisplay, int unused_edx, EQSPAWNINFO* entity, int new_material, int old_material_or_head, DWORD color, bool from_server)
@@ -3695,11 +4503,7 @@ int __fastcall SwapHead_Detour(int* cDisplay, int unused_edx, EQSPAWNINFO* entit
 		old_material_or_head = EQPlayer::GetHeadID(entity, old_material_or_head);
 
 		// (2a) Fix broken Velious races by using a special head with no hair/hood graphics underneath their helmet. This stops their hair/hood clipping through the helm.
-		use_bald_head = new_material >= kMaterialVeliousHelm && IsHelmPatchedOldModel(entity->Race, entity->Gender);
-		if (use_bald_head)
-		{
-			PatchSwap(0x4A1C65 + 1, BYTE_BALD_HEAD, 1); // Changes default head 0 -> 5
-		}
+		use_bald_head = SwapHead_DefaultHeadThunk && new_material >= kMaterialVeliousHelm && IsHelmPatchedOldModel(entity->Race, entity->Gender);
 
 		// (3) Fixes a bug that double-sends packets on materials below 240. Suppresses the extra packet (which also contains the wrong value).
 		if (new_material < kMaterialVeliousHelm || block_outbound_wearchange > 0)
@@ -3712,17 +4516,15 @@ int __fastcall SwapHead_Detour(int* cDisplay, int unused_edx, EQSPAWNINFO* entit
 	}
 
 	// Call SwapHead()
+	DWORD default_head = SwapHead_DefaultHead; // Saved and restored, so a nested SwapHead() can't leave the wrong head behind
+	if (use_bald_head)
+		SwapHead_DefaultHead = kMaterialBaldHead; // Changes default head 0 -> 5
 	int result = SwapHead_Trampoline(cDisplay, entity, new_material, old_material_or_head, color, from_server);
+	SwapHead_DefaultHead = default_head;
 
 	// (5) Fixes SwapHead() to save material values correctly when material >255. The original method only sets the lo-byte, but the storage supports uint16.
 	entity->EquipmentMaterialType[kMaterialSlotHead] = new_material;
 
-	// (2b) Unpatch the Change from (2a)
-	if (use_bald_head)
-	{
-		PatchSwap(0x4A1C65 + 1, BYTE_NORMAL_HEAD, 1); // Changes default head 5 -> 0
-	}
-
 	return result;
 }
 
@@ -3747,11 +4549,56 @@ void __fastcall WearChangeArmor_Detour(int* cDisplay, int unused_edx, EQSPAWNINF
 	block_outbound_wearchange -= block_wearchange;
 }
 
+// "IT###" -> ###, 0 for anything shorter (same as the old strlen/atoi, without walking the string twice)
+inline int ParseITMaterial(const char* ITstr)
+{
+	if (!ITstr || !ITstr[0] || !ITstr[1] || !ITstr[2])
+		return 0;
+	int material = 0;
+	for (const char* p = &ITstr[2]; *p >= '0' && *p <= '9'; p++)
+		material = material * 10 + (*p - '0');
+	return material;
+}
+
+// Item -> material (EQ_Item::GetItemMaterial) for the slots SwapModel_Detour matches against. Entries are keyed by the
+// item pointer and keep a copy of the fields the material came from; a different item in the slot just misses, and an
+// item whose memory was reused for something else fails the compare. So nothing has to hook inventory changes, and
+// weapon swaps don't re-parse IdFile.
+struct ItemMaterialCacheEntry {
+	EQITEMINFO* item;
+	BYTE is_container;
+	BYTE common_material;
+	CHAR id_file[sizeof(((EQITEMINFO*)0)->IdFile)];
+	WORD material;
+};
+constexpr size_t kItemMaterialCacheSize = 8;
+ItemMaterialCacheEntry ItemMaterialCache[kItemMaterialCacheSize];
+size_t ItemMaterialCacheNext = 0;
+
+WORD GetCachedItemMaterial(EQITEMINFO* item)
+{
+	if (!item)
+		return kMaterialNone;
+	for (ItemMaterialCacheEntry& entry : ItemMaterialCache) {
+		if (entry.item == item && entry.is_container == item->IsContainer && entry.common_material == item->Common.Material
+			&& memcmp(entry.id_file, item->IdFile, sizeof(entry.id_file)) == 0)
+			return entry.material;
+	}
+	ItemMaterialCacheEntry& entry = ItemMaterialCache[ItemMaterialCacheNext];
+	ItemMaterialCacheNext = (ItemMaterialCacheNext + 1) % kItemMaterialCacheSize;
+	entry.item = item;
+	entry.is_container = item->IsContainer;
+	entry.common_material = item->Common.Material;
+	memcpy(entry.id_file, item->IdFile, sizeof(entry.id_file));
+	entry.material = EQ_Item::GetItemMaterial(item);
+	return entry.material;
+}
+
 typedef int(__thiscall* EQ_FUNCTION_TYPE_SwapModel)(int* cdisplay, EQSPAWNINFO* entity, int wear_slot, char* ITstr, int from_server);
 EQ_FUNCTION_TYPE_SwapModel SwapModel_Trampoline;
 int __fastcall SwapModel_Detour(int* cDisplay, int unused, EQSPAWNINFO* entity, BYTE wear_slot, char* ITstr, int from_server)
 {
-	int material = (ITstr && strlen(ITstr) > 2) ? atoi(&ITstr[2]) : 0;
+	int material = ParseITMaterial(ITstr);
 	bool is_weapon_slot = wear_slot == kMaterialSlotPrimary || wear_slot == kMaterialSlotSecondary;
 	bool is_tint_slot = is_weapon_slot || (wear_slot == kMaterialSlotHead && entity->Texture == 0xFF);
 
@@ -3769,11 +4616,11 @@ int __fastcall SwapModel_Detour(int* cDisplay, int unused, EQSPAWNINFO* entity,
 		{
 			EQPlayer::SaveMaterialColor(entity, wear_slot, inv.Primary ? inv.Primary->Common.Color : kColorNone);
 		}
-		else if (EQ_Item::GetItemMaterial(inv.Secondary) == material)
+		else if (GetCachedItemMaterial(inv.Secondary) == material)
 		{
 			EQPlayer::SaveMaterialColor(entity, wear_slot, inv.Secondary ? inv.Secondary->Common.Color : kColorNone);
 		}
-		else if (EQ_Item::GetItemMaterial(inv.Ranged) == material)
+		else if (GetCachedItemMaterial(inv.Ranged) == material)
 		{
 			EQPlayer::SaveMaterialColor(entity, wear_slot, inv.Ranged ? inv.Ranged->Common.Color : kColorNone);
 		}
@@ -3852,21 +4699,30 @@ bool Handle_Out_OP_WearChange(WearChange_Struct* wc)
 
 void ApplyTintPatches()
 {
+	PatchTransaction patches;
+
 	// GetVeliousHelmMaterialIT_4A1512(entity, material, *show_hair)
 	// - (1) Disables hair becoming invisible on the shared default head. Prevents "show_hair = false" happening with Velious helms.
-	PatchNopByRange(0x4A159B, 0x4A159D); // '*show_hair = 0' -> No-OP
-	PatchNopByRange(0x4A16D2, 0x4A16D4); // '*show_hair = 0' -> No-OP
+	patches.Nop(0x4A159B, 0x4A159D); // '*show_hair = 0' -> No-OP
+	patches.Nop(0x4A16D2, 0x4A16D4); // '*show_hair = 0' -> No-OP
 	// - (2) Enables Velious Helms showing on Character Select. Prevents returning early if char_info is null.
-	PatchNopByRange(0x4A152B, 0x4A1533); // 'if (!char_info) return 3'; -> No-OP
-	PatchNopByRange(0x4A153E, 0x4A154B); // 'if ((char_info->Unknown0D3C & 0x1E) == 0) return 3;' -> No-OP
+	patches.Nop(0x4A152B, 0x4A1533); // 'if (!char_info) return 3'; -> No-OP
+	patches.Nop(0x4A153E, 0x4A154B); // 'if ((char_info->Unknown0D3C & 0x1E) == 0) return 3;' -> No-OP
 
 	// ChangeDag()
 	// - Unlocks proper tinting for IT# model helms/weapons below IT# number 1000:
 	// - IT# models under ID 1000 used shared memory in their tint storage, so setting the tint on one model affected all models in the zone.
 	DWORD value1 = 1;
-	PatchA((void*)(0x4B094E + 3), (const void*)&value1, sizeof(DWORD));
-	PatchA((void*)(0x4B099E + 3), (const void*)&value1, sizeof(DWORD));
-	
+	patches.Write(0x4B094E + 3, &value1, sizeof(DWORD));
+	patches.Write(0x4B099E + 3, &value1, sizeof(DWORD));
+
+	// All or nothing, a partially applied set would leave helms half-fixed
+	if (!patches.Commit())
+	{
+#ifdef LOGGING
+		WriteLog("ApplyTintPatches: Failed to unprotect code pages, no patches applied.");
+#endif
+	}
 }
 
 // ---------------------------------------------------------------------------------------
@@ -3888,17 +4744,17 @@ void CheckPromptUIChoice()
 	char szResult[255];
 	char szDefault[255];
 	sprintf(szDefault, "%s", "NONE");
-	DWORD error = GetPrivateProfileStringA("Defaults", "OldUI", szDefault, szResult, 255, "./eqclient.ini");
+	IniStore_Get("Defaults", "OldUI", szDefault, szResult, sizeof(szResult));
 	if (strcmp(szResult, "NONE") == 0) // File not found
 	{
 		int Result = MessageBox(EQhWnd, "This server supports running both the Stone (Pre-Luclin) UI, and the more modern Luclin UI.\n Would you like to use the Luclin UI? This can later be adjusted ingame by typing /oldui.", "EverQuest", MB_YESNO);
 		if (Result == IDYES)
 		{
-			WritePrivateProfileStringA_tramp("Defaults", "OldUI", "FALSE", "./eqclient.ini");
+			IniStore_Set("Defaults", "OldUI", "FALSE");
 		}
 		else
 		{
-			WritePrivateProfileStringA_tramp("Defaults", "OldUI", "TRUE", "./eqclient.ini");
+			IniStore_Set("Defaults", "OldUI", "TRUE");
 		}
 
 	}
@@ -3910,14 +4766,14 @@ void CheckClientMiniMods()
 	char szResult[255];
 	char szDefault[255];
 	sprintf(szDefault, "%s", "NONE");
-	DWORD error = GetPrivateProfileStringA("Defaults", "EnableBrownSkeletonHack", szDefault, szResult, 255, "./eqclient.ini");
+	IniStore_Get("Defaults", "EnableBrownSkeletonHack", szDefault, szResult, sizeof(szResult));
 	if (strcmp(szResult, "FALSE") == 0) // False
 	{
 		g_bEnableBrownSkeletons = false;
 	}
 	else if (strcmp(szResult, "NONE") == 0) // Not found
 	{
-		WritePrivateProfileStringA_tramp("Defaults", "EnableBrownSkeletonHack", "FALSE", "./eqclient.ini");
+		IniStore_Set("Defaults", "EnableBrownSkeletonHack", "FALSE");
 	}
 	else // any other value (1, true, potato)
 	{
@@ -3925,7 +4781,7 @@ void CheckClientMiniMods()
 	}
 
 
-	error = GetPrivateProfileStringA("Defaults", "EnableExtendedNameplateDistance", szDefault, szResult, 255, "./eqclient.ini");
+	IniStore_Get("Defaults", "EnableExtendedNameplateDistance", szDefault, szResult, sizeof(szResult));
 	if (strcmp(szResult, "FALSE") == 0) // False
 	{
 		g_bEnableExtendedNameplates = false;
@@ -3933,14 +4789,14 @@ void CheckClientMiniMods()
 	else if (strcmp(szResult, "NONE") == 0) // Not found
 	{
 		g_bEnableExtendedNameplates = false;
-		WritePrivateProfileStringA_tramp("Defaults", "EnableExtendedNameplateDistance", "FALSE", "./eqclient.ini");
+		IniStore_Set("Defaults", "EnableExtendedNameplateDistance", "FALSE");
 	}
 	else
 	{
 		g_bEnableExtendedNameplates = true;
 	}
 
-	error = GetPrivateProfileStringA("Defaults", "EnableClassicMusic", szDefault, szResult, 255, "./eqclient.ini");
+	IniStore_Get("Defaults", "EnableClassicMusic", szDefault, szResult, sizeof(szResult));
 	if (strcmp(szResult, "FALSE") == 0) // False
 	{
 		g_bEnableClassicMusic = false;
@@ -3948,7 +4804,7 @@ void CheckClientMiniMods()
 	else if (strcmp(szResult, "NONE") == 0) // Not found
 	{
 		g_bEnableClassicMusic = false;
-		WritePrivateProfileStringA_tramp("Defaults", "EnableClassicMusic", "FALSE", "./eqclient.ini");
+		IniStore_Set("Defaults", "EnableClassicMusic", "FALSE");
 	}
 	else
 	{
@@ -3958,7 +4814,7 @@ void CheckClientMiniMods()
 		//EzDetour(0x004D518B, &Eqmachooks::CEQMusicManager__WavPlay_Detour, &Eqmachooks::CEQMusicManager__WavPlay_Trampoline);
 	}
 
-	error = GetPrivateProfileStringA("Defaults", "SongWindowAutoHide", szDefault, szResult, 255, "./eqclient.ini");
+	IniStore_Get("Defaults", "SongWindowAutoHide", szDefault, szResult, sizeof(szResult));
 	if (strcmp(szResult, "TRUE") == 0) // True
 	{
 		g_bSongWindowAutoHide = true;
@@ -3966,7 +4822,7 @@ void CheckClientMiniMods()
 	else if (strcmp(szResult, "NONE") == 0) // Not found
 	{
 		g_bSongWindowAutoHide = false;
-		WritePrivateProfileStringA_tramp("Defaults", "SongWindowAutoHide", "FALSE", "./eqclient.ini");
+		IniStore_Set("Defaults", "SongWindowAutoHide", "FALSE");
 	}
 	else // Default off
 	{
@@ -3976,9 +4832,15 @@ void CheckClientMiniMods()
 
 void InitHooks()
 {
+	StartupPhaseTimer phase("InitHooks");
+	IniStore_Load();
+
+	// The plain byte patches InitHooks makes itself go into one transaction, committed after the last of them
+	PatchTransaction init_patches;
+
 	//bypass filename req
 	const char test3[] = { 0x90, 0x90, 0x90, 0x90, 0x90, 0x90,0x90, 0xEB, 0x1B, 0x90, 0x90, 0x90, 0x90 };
-	PatchA((DWORD*)0x005595A7, &test3, sizeof(test3));
+	init_patches.Write(0x005595A7, test3, sizeof(test3));
 
 	HMODULE eqgfx_dll = LoadLibraryA("eqgfx_dx8.dll");
 	if (eqgfx_dll)
@@ -4092,31 +4954,41 @@ void InitHooks()
 	EQPlayer__AttachPlayerToDag_Trampoline = (EQ_FUNCTION_TYPE_EQPlayer__AttachPlayerToDag)DetourFunction((PBYTE)0x4B079F, (PBYTE)EQPlayer__AttachPlayerToDag_Detour);
 	EQPlayer__Dismount_Trampoline = (EQ_FUNCTION_TYPE_EQPlayer__Dismount)DetourFunction((PBYTE)0x51FF5F, (PBYTE)EQPlayer__Dismount_Detour);
 	DetourFunction((PBYTE)0x51FCE6, (PBYTE)IsHorse);
+	HorseRace_Init();
+	OnZoneCallbacks.Add(HorseRace_OnZone);
 	
 
 	// Sends DLL_VERSION to the server on zone-in
-	OnZoneCallbacks.push_back(SendDllVersion_OnZone);
-	CustomSpawnAppearanceMessageHandlers.push_back(HandleDllVersionRequest);
+	OnZoneCallbacks.Add(SendDllVersion_OnZone, CallbackPriority_Early);
+	CustomSpawnAppearanceMessageHandlers.Add(HandleDllVersionRequest, CallbackPriority_Early);
 
 	// [BuffStackingPatch:Main]
 	EQCharacter__FindAffectSlot_Trampoline = (EQ_FUNCTION_TYPE_EQCharacter__FindAffectSlot)DetourFunction((PBYTE)0x004C7A3E, (PBYTE)EQCharacter__FindAffectSlot_Detour);
-	OnZoneCallbacks.push_back(BuffstackingPatch_OnZone);
-	CustomSpawnAppearanceMessageHandlers.push_back(BuffstackingPatch_HandleHandshake);
+	OnZoneCallbacks.Add(BuffstackingPatch_OnZone);
+	CustomSpawnAppearanceMessageHandlers.Add(BuffstackingPatch_HandleHandshake);
 	// [BuffStackingPacth:SongWindow]
 	EQCharacter__GetBuff_Trampoline = (EQ_FUNCTION_TYPE_EQCharacter__GetBuff)DetourFunction((PBYTE)0x004C465A, (PBYTE)EQCharacter__GetBuff_Detour); // Supports reading buffs 16-30 in Song Window
 	EQCharacter__GetMaxBuffs_Trampoline = (EQ_FUNCTION_TYPE_EQCharacter__GetMaxBuffs)DetourFunction((PBYTE)0x004C4637, (PBYTE)EQCHARACTER__GetMaxBuffs_Detour); // Uses 16+ buffs for buff loops (stat calcs etc)
+	EQCharacter__TotalSpellAffects_Trampoline = (EQ_FUNCTION_TYPE_EQCharacter__TotalSpellAffects)DetourFunction((PBYTE)0x4C6B6D, (PBYTE)EQCharacter__TotalSpellAffects_Detour); // Caches per-SPA buff totals (see Spell Affect Cache)
+	OnZoneCallbacks.Add(SpellAffectCache_Reset);
 	DetourFunction((PBYTE)0x00408FF1, (PBYTE)CBuffWindow__WndNotification_Detour); // Handles clicking off buffs 16+ on song window
 	ApplySongWindowBytePatches(); // Fixes OP_Buff to work on all 30 slots
-	InitGameUICallbacks.push_back(ShortBuffWindow_InitUI); // Loads Song window
-	ActivateUICallbacks.push_back(ShowBuffWindow_ActivateUI);
-	CleanUpUICallbacks.push_back(ShortBuffWindow_CleanUI);
-	DeactivateUICallbacks.push_back(ShowBuffWindow_DeactivateUI);
+	InitGameUICallbacks.Add(ShortBuffWindow_InitUI); // Loads Song window
+	ActivateUICallbacks.Add(ShowBuffWindow_ActivateUI);
+	CleanUpUICallbacks.Add(ShortBuffWindow_CleanUI);
+
+	// eqclient.ini: dirty keys are written back at camp (UI cleanup) and quit
+	CleanUpUICallbacks.Add(IniStore_Flush, CallbackPriority_Late);
+	DeactivateUICallbacks.Add(ShowBuffWindow_DeactivateUI);
 
 	// Appearance / Tint Support
 	SwapHead_Trampoline = (EQ_FUNCTION_TYPE_SwapHead)DetourFunction((PBYTE)0x4A1735, (PBYTE)SwapHead_Detour);
+	InstallSwapHeadDefaultHeadThunk(); // Bald head swaps for SwapHead_Detour
 	SwapModel_Trampoline = (EQ_FUNCTION_TYPE_SwapModel)DetourFunction((PBYTE)0x4A9EB3, (PBYTE)SwapModel_Detour);
 	WearChangeArmor_Trampoline = (EQ_FUNCTION_TYPE_WearChangeArmor)DetourFunction((PBYTE)0x4A2A7A, (PBYTE)WearChangeArmor_Detour);
 	ApplyTintPatches();
+	OnZoneCallbacks.Add(WearChangeQueue_Clear); // Queued WearChanges belong to the old zone's spawns
+	CleanUpUICallbacks.Add(WearChangeQueue_Clear);
 
 	// Mesmerization Stun Duration fix
 	ApplyMesmerizationFixes();
@@ -4150,11 +5022,18 @@ void InitHooks()
 
 	// Fix bug with option window UI skin load dialog always loading default instead of selected skin
 	uintptr_t addr = (intptr_t)sprintf_Detour_loadskin - (intptr_t)0x00426115;
-	PatchA((void *)0x00426111, &addr, 4);
+	init_patches.Write(0x00426111, &addr, 4);
 
 	// Fix bug with spell casting bar not showing at high spell haste values
 	unsigned char jge = 0x7D;
-	PatchA((void *)0x004c55b7, &jge, 1);
+	init_patches.Write(0x004c55b7, &jge, 1);
+
+	if (!init_patches.Commit())
+	{
+#ifdef LOGGING
+		WriteLog("InitHooks: Failed to unprotect code pages, filename/skin/casting bar patches not applied.");
+#endif
+	}
 
 	//this one is here for eqplaynice - eqmule
 
@@ -4171,10 +5050,10 @@ void InitHooks()
 	char szResult[255];
 	char szDefault[255];
 	sprintf(szDefault, "%s", "TRUE");
-	DWORD error = GetPrivateProfileStringA("Options", "WindowedMode", szDefault, szResult, 255, "./eqclient.ini");
-	if (GetLastError())
+	bool found = IniStore_Get("Options", "WindowedMode", szDefault, szResult, sizeof(szResult));
+	if (!found)
 	{
-		WritePrivateProfileStringA_tramp("Options", "WindowedMode", szDefault, "./eqclient.ini");
+		IniStore_WriteThrough("Options", "WindowedMode", szDefault);
 	}
 	if (!strcmp(szResult, "FALSE")) {
 		start_fullscreen = true;
@@ -4184,31 +5063,31 @@ void InitHooks()
 	}
 
 	sprintf(szDefault, "%d", 1);
-	error = GetPrivateProfileStringA("Options", "MouseRightHanded", szDefault, szResult, 255, "./eqclient.ini");
-	if (!GetLastError()) {
+	found = IniStore_Get("Options", "MouseRightHanded", szDefault, szResult, sizeof(szResult));
+	if (found) {
 		if (!strcmp(szResult, "0"))
 			RightHandMouse = false;
 	}
 	else {
-		WritePrivateProfileStringA_tramp("Options", "MouseRightHanded", szDefault, "./eqclient.ini");
+		IniStore_WriteThrough("Options", "MouseRightHanded", szDefault);
 	}
 
 	sprintf(szDefault, "%d", 32);
-	error = GetPrivateProfileStringA("Defaults", "VideoModeBitsPerPixel", szDefault, szResult, 255, "./eqclient.ini");
-	if (!GetLastError())
+	found = IniStore_Get("Defaults", "VideoModeBitsPerPixel", szDefault, szResult, sizeof(szResult));
+	if (found)
 	{
 		// if set to 16 bit, change to 32
 		if (!strcmp(szResult, "16"))
-			WritePrivateProfileStringA_tramp("Defaults", "VideoModeBitsPerPixel", szDefault, "./eqclient.ini");
+			IniStore_WriteThrough("Defaults", "VideoModeBitsPerPixel", szDefault);
 	}
 	
 	sprintf(szDefault, "%d", 32);
-	error = GetPrivateProfileStringA("VideoMode", "BitsPerPixel", szDefault, szResult, 255, "./eqclient.ini");
-	if (!GetLastError())
+	found = IniStore_Get("VideoMode", "BitsPerPixel", szDefault, szResult, sizeof(szResult));
+	if (found)
 	{
 		// if set to 16 bit, change to 32
 		if (!strcmp(szResult, "16"))
-			WritePrivateProfileStringA_tramp("VideoMode", "BitsPerPixel", szDefault, "./eqclient.ini");
+			IniStore_WriteThrough("VideoMode", "BitsPerPixel", szDefault);
 	}
 	else {
 		// we do not have one set
@@ -4225,16 +5104,18 @@ void InitHooks()
 			freq = dm.dmDisplayFrequency;
 		}
 		sprintf(szDefault, "%d", freq);
-		WritePrivateProfileStringA_tramp("VideoMode", "RefreshRate", szDefault, "./eqclient.ini");
+		IniStore_WriteThrough("VideoMode", "RefreshRate", szDefault);
 		sprintf(szDefault, "%d", bits);
-		WritePrivateProfileStringA_tramp("VideoMode", "BitsPerPixel", szDefault, "./eqclient.ini");
+		IniStore_WriteThrough("VideoMode", "BitsPerPixel", szDefault);
 	}
 
 	// turn on chat keepalive
 	sprintf(szDefault, "%d", 1);
-	WritePrivateProfileStringA_tramp("Defaults", "ChatKeepAlive", szDefault, "./eqclient.ini");
-	CheckClientMiniMods();
-	InitRaceShortCodeMap();
+	IniStore_Get("Defaults", "ChatKeepAlive", "", szResult, sizeof(szResult));
+	if (strcmp(szResult, szDefault) != 0)
+		IniStore_WriteThrough("Defaults", "ChatKeepAlive", szDefault);
+	CheckClientMiniMods(); // Its defaults are ours, so they wait for the next flush
+	// InitRaceShortCodeMap runs on the init thread (DeferredInit_Start)
 	bInitalized=true;
 }
 
@@ -4286,8 +5167,15 @@ BOOL APIENTRY DllMain( HANDLE hModule, DWORD  ul_reason_for_call, LPVOID lpReser
 	if (ul_reason_for_call==DLL_PROCESS_ATTACH)
 	{
 		InitHooks();
-		LoadIniSettings();
-		SetEQhWnd();
+		{
+			StartupPhaseTimer phase("LoadIniSettings");
+			LoadIniSettings();
+		}
+		{
+			StartupPhaseTimer phase("SetEQhWnd");
+			SetEQhWnd();
+		}
+		DeferredInit_Start(); // RaceData.txt
 		//CheckPromptUIChoice();
 		return TRUE;
 	}
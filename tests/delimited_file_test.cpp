@@ -0,0 +1,187 @@
+#include "delimited_file.h"
+#include "test_util.h"
+
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+typedef std::vector<std::vector<std::string>> Rows;
+
+// The std::getline parser DelimitedFile replaced (parseCSVWithIndex), with the CRLF handling the Windows text-mode
+// ifstream it read through did
+Rows OldParse(const std::string& text)
+{
+	Rows rows;
+	std::istringstream file(text);
+	std::string line;
+	while (std::getline(file, line)) {
+		if (!line.empty() && line.back() == '\r')
+			line.pop_back();
+		std::vector<std::string> row;
+		std::stringstream line_stream(line);
+		std::string cell;
+		while (std::getline(line_stream, cell, '^'))
+			row.push_back(cell);
+		rows.push_back(row);
+	}
+	return rows;
+}
+
+// Rows past MAX_COLUMNS only have their first MAX_COLUMNS filled in, so the rest is compared by count
+bool SameAsOldParse(const std::string& text)
+{
+	Rows old_rows = OldParse(text);
+	size_t index = 0;
+	bool same = true;
+	DelimitedFile::ForEachRow(text.data(), text.size(), [&](const DelimitedField* columns, size_t count) {
+		if (index >= old_rows.size() || old_rows[index].size() != count) {
+			same = false;
+			return;
+		}
+		for (size_t i = 0; i < count && i < DelimitedFile::MAX_COLUMNS; i++)
+			same = same && old_rows[index][i] == std::string(columns[i].text, columns[i].length);
+		index++;
+	});
+	return same && index == old_rows.size();
+}
+
+std::string WriteTemp(const char* name, const std::string& text)
+{
+	std::string path = std::string("delimited_file_test_") + name + ".txt";
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	file << text;
+	return path;
+}
+
+void TestSplitting()
+{
+	const char* cases[] = {
+		"",
+		"\n",
+		"a^b^c",
+		"a^b^c\n",
+		"a^b^c\r\nd^e\r\n",
+		"a^^c\n^b\n^\n^^\n",
+		"1^qeynos^South Qeynos^\n2^qeynos2^North Qeynos^\n",
+		"\n\nx\n\n",
+		"trailing^\r\n",
+	};
+	for (const char* text : cases)
+		CHECK(SameAsOldParse(text));
+
+	// Random lines over the characters that matter
+	std::mt19937 random(7);
+	const char alphabet[] = { 'a', '7', '-', ' ', '^', '^', '\n' };
+	for (int i = 0; i < 2000; i++) {
+		std::string text;
+		size_t length = random() % 64;
+		for (size_t j = 0; j < length; j++) {
+			char c = alphabet[random() % sizeof(alphabet)];
+			if (c == '\n' && random() % 2)
+				text += '\r';
+			text += c;
+		}
+		CHECK(SameAsOldParse(text));
+	}
+}
+
+void TestColumnCount()
+{
+	// The count stays exact past MAX_COLUMNS, only the first MAX_COLUMNS are filled in
+	std::string text;
+	for (int i = 0; i < 20; i++)
+		text += std::to_string(i) + "^";
+	size_t seen = 0;
+	int last = -1;
+	DelimitedFile::ForEachRow(text.data(), text.size(), [&](const DelimitedField* columns, size_t count) {
+		seen = count;
+		last = columns[DelimitedFile::MAX_COLUMNS - 1].ToInt();
+	});
+	CHECK(seen == 20);
+	CHECK(last == (int)DelimitedFile::MAX_COLUMNS - 1);
+}
+
+void TestToInt()
+{
+	const char* cases[] = { "0", "42", "-17", "+5", "  12", "\t-3x", "abc", "", "-", "2147483647", "007" };
+	for (const char* text : cases) {
+		DelimitedField field = { text, strlen(text) };
+		CHECK(field.ToInt() == atoi(text));
+	}
+	// Stops at the end of the column, not at the NUL
+	DelimitedField prefix = { "12345", 3 };
+	CHECK(prefix.ToInt() == 123);
+}
+
+void TestMappedFile()
+{
+	std::string text = "1^a^b\r\n2^c^d\r\n";
+	DelimitedFile file(WriteTemp("rows", text).c_str());
+	CHECK(file.IsOpen());
+	Rows rows;
+	file.ForEachRow([&](const DelimitedField* columns, size_t count) {
+		std::vector<std::string> row;
+		for (size_t i = 0; i < count; i++)
+			row.push_back(std::string(columns[i].text, columns[i].length));
+		rows.push_back(row);
+	});
+	CHECK(rows == OldParse(text));
+
+	DelimitedFile empty(WriteTemp("empty", "").c_str());
+	CHECK(!empty.IsOpen());
+	DelimitedFile missing("delimited_file_test_missing.txt");
+	CHECK(!missing.IsOpen());
+	int calls = 0;
+	missing.ForEachRow([&](const DelimitedField*, size_t) { calls++; });
+	CHECK(calls == 0);
+}
+
+void BenchmarkParse()
+{
+	// ZoneData.txt-shaped rows
+	std::string text;
+	for (int i = 0; i < 200000; i++)
+		text += std::to_string(i) + "^zone" + std::to_string(i) + "^The Zone Number " + std::to_string(i) + "^" + std::to_string(i % 7) + "^1^0\r\n";
+	std::string path = WriteTemp("bench", text);
+
+	auto start = std::chrono::steady_clock::now();
+	size_t old_rows = 0;
+	{
+		std::ifstream file(path);
+		std::string line;
+		while (std::getline(file, line)) {
+			std::vector<std::string> row;
+			std::stringstream line_stream(line);
+			std::string cell;
+			while (std::getline(line_stream, cell, '^'))
+				row.push_back(cell);
+			old_rows += atoi(row[0].c_str()) >= 0;
+		}
+	}
+	double old_seconds = SecondsSince(start);
+
+	start = std::chrono::steady_clock::now();
+	size_t new_rows = 0;
+	{
+		DelimitedFile file(path.c_str());
+		file.ForEachRow([&](const DelimitedField* columns, size_t count) {
+			new_rows += count > 0 && columns[0].ToInt() >= 0;
+		});
+	}
+	double new_seconds = SecondsSince(start);
+
+	CHECK(old_rows == 200000 && new_rows == 200000);
+	printf("200k rows (%.1f MB): getline %.1f ms, DelimitedFile %.1f ms\n", text.size() / 1048576.0, old_seconds * 1000, new_seconds * 1000);
+}
+
+int main()
+{
+	TestSplitting();
+	TestColumnCount();
+	TestToInt();
+	TestMappedFile();
+	BenchmarkParse();
+	return test_failures;
+}
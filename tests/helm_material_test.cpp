@@ -0,0 +1,86 @@
+#include "helm_material.h"
+#include "test_util.h"
+
+#include <random>
+#include <vector>
+
+// ToCanonicalHelmMaterial as it was before the table (a switch per call)
+uint16_t OldToCanonicalHelmMaterial(uint16_t material, uint16_t race)
+{
+	if ((race >= 1 && race <= 12) || race == 128 || race == 130)
+	{
+		switch (material)
+		{
+		case 661: case 666:
+			return kMaterialLeather;
+		case 662: case 667:
+			return kMaterialChain;
+		case 663: case 668:
+			return kMaterialPlate;
+		case 665: case 660: case 627: case 620: case 537: case 530: case 570: case 575: case 565: case 561:
+		case 605: case 600: case 545: case 540: case 595: case 590: case 557: case 550: case 655: case 650:
+		case 645: case 640: case 615: case 610: case 585: case 580: case 635: case 630:
+			if (race == 130)
+				return kMaterialPlate;
+			return kMaterialVeliousHelm;
+		case 641: case 646:
+			if (race == 10)
+				return kMaterialVeliousHelmAlternate;
+			return kMaterialVeliousHelm;
+		}
+	}
+	return material;
+}
+
+void TestMatchesOldSwitch()
+{
+	int mismatches = 0;
+	for (uint32_t race = 0; race <= 0xFFFF; race++) {
+		for (uint16_t material = 0; material <= 1000; material++) {
+			if (ToCanonicalHelmMaterial(material, (uint16_t)race) != OldToCanonicalHelmMaterial(material, (uint16_t)race))
+				mismatches++;
+		}
+	}
+	CHECK(mismatches == 0);
+}
+
+// The table is built by the compiler
+static_assert(HelmMaterialTable.canonical[HelmRace_Playable][620 - kHelmMaterialTableFirst] == kMaterialVeliousHelm, "Human helm");
+static_assert(HelmMaterialTable.canonical[HelmRace_VahShir][620 - kHelmMaterialTableFirst] == kMaterialPlate, "Vah Shir wear plate");
+static_assert(HelmMaterialTable.canonical[HelmRace_Ogre][641 - kHelmMaterialTableFirst] == kMaterialVeliousHelmAlternate, "Ogre alternate");
+static_assert(HelmMaterialTable.canonical[HelmRace_Other][620 - kHelmMaterialTableFirst] == 620, "Pass-through");
+
+void BenchmarkConvert()
+{
+	// Outbound head materials as they come in: mostly race-specific helms, some plain armor
+	std::mt19937 random(9);
+	std::vector<uint16_t> materials(1 << 16), races(1 << 16);
+	for (size_t i = 0; i < materials.size(); i++) {
+		materials[i] = (uint16_t)(random() % 4 ? 530 + random() % 139 : random() % 4);
+		races[i] = (uint16_t)(1 + random() % 12);
+	}
+	const int runs = 200;
+	unsigned sum = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (int run = 0; run < runs; run++) {
+		for (size_t i = 0; i < materials.size(); i++)
+			sum += OldToCanonicalHelmMaterial(materials[i], races[i]);
+	}
+	double old_seconds = SecondsSince(start);
+	start = std::chrono::steady_clock::now();
+	for (int run = 0; run < runs; run++) {
+		for (size_t i = 0; i < materials.size(); i++)
+			sum -= ToCanonicalHelmMaterial(materials[i], races[i]);
+	}
+	double new_seconds = SecondsSince(start);
+	CHECK(sum == 0);
+	double conversions = (double)runs * materials.size();
+	printf("ToCanonicalHelmMaterial: switch %.2f ns, table %.2f ns per conversion\n", old_seconds * 1e9 / conversions, new_seconds * 1e9 / conversions);
+}
+
+int main()
+{
+	TestMatchesOldSwitch();
+	BenchmarkConvert();
+	return test_failures;
+}
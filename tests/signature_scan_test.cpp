@@ -0,0 +1,111 @@
+#include "signature_scan.h"
+#include "test_util.h"
+
+#include <random>
+
+// Synthetic .text sections: random filler with a known function dropped in. The "rebuilt" image moves the function and
+// changes its call target and the global it reads, which is what the learned signature has to survive.
+constexpr uintptr_t kImageBase = 0x00400000;
+constexpr uintptr_t kImageEnd = 0x00900000;
+constexpr size_t kFunctionLength = 24;
+
+std::vector<uint8_t> RandomText(size_t size, unsigned seed)
+{
+	std::mt19937 random(seed);
+	std::vector<uint8_t> text(size);
+	for (auto& byte : text)
+		byte = (uint8_t)random();
+	return text;
+}
+
+void PutFunction(std::vector<uint8_t>& text, size_t offset, uint32_t global, uint32_t call_rel)
+{
+	const uint8_t function[kFunctionLength] = {
+		0x55,                               // push ebp
+		0x8B, 0xEC,                         // mov ebp, esp
+		0x83, 0xEC, 0x10,                   // sub esp, 10h
+		0x56,                               // push esi
+		0x8B, 0x35, 0, 0, 0, 0,             // mov esi, [global]
+		0xE8, 0, 0, 0, 0,                   // call rel32
+		0x85, 0xC0,                         // test eax, eax
+		0x74, 0x08,                         // je +8
+		0x5E,                               // pop esi
+		0xC3,                               // ret
+	};
+	memcpy(&text[offset], function, kFunctionLength);
+	memcpy(&text[offset + 9], &global, 4);
+	memcpy(&text[offset + 14], &call_rel, 4);
+}
+
+void TestLearn()
+{
+	std::vector<uint8_t> text = RandomText(0x10000, 1);
+	PutFunction(text, 0x1234, 0x00812345, 0x00001000);
+	Signature signature = Signature_Learn(&text[0x1234], kFunctionLength, kImageBase, kImageEnd);
+	CHECK(signature.size() == kFunctionLength);
+	for (size_t i = 0; i < kFunctionLength; i++) {
+		bool wildcard = (i >= 9 && i < 13) || (i >= 14 && i < 18); // The global and the call's rel32
+		CHECK((signature[i] < 0) == wildcard);
+	}
+	CHECK(Signature_ToString(signature) == "55 8B EC 83 EC 10 56 8B 35 ?? ?? ?? ?? E8 ?? ?? ?? ?? 85 C0 74 08 5E C3");
+	CHECK(Signature_FromString(Signature_ToString(signature).c_str()) == signature);
+	CHECK(Signature_FromString("55 ? 8B zz") == Signature({ 0x55, -1, 0x8B }));
+}
+
+void TestScan()
+{
+	std::vector<uint8_t> original = RandomText(0x10000, 2);
+	PutFunction(original, 0x100, 0x00812345, 0x00001000);
+	Signature signature = Signature_Learn(&original[0x100], kFunctionLength, kImageBase, kImageEnd);
+
+	// Rebuilt client: moved, different global and call target
+	std::vector<uint8_t> rebuilt = RandomText(0x20000, 3);
+	PutFunction(rebuilt, 0x8003, 0x00813000, 0xFFFF0000);
+	const uint8_t* begin = rebuilt.data();
+	const uint8_t* end = begin + rebuilt.size();
+	CHECK(Signature_Scan(begin, end, signature) == begin + 0x8003);
+	CHECK(Signature_Matches(begin + 0x8003, signature));
+
+	// Two copies: not unique, so no answer
+	PutFunction(rebuilt, 0x10000, 0x00813000, 0x00000010);
+	CHECK(Signature_Scan(begin, end, signature) == nullptr);
+
+	// Only in the last bytes (the scalar tail after the SSE2 blocks)
+	std::vector<uint8_t> tail = RandomText(0x1001, 4);
+	PutFunction(tail, tail.size() - kFunctionLength, 0x00813000, 0);
+	CHECK(Signature_Scan(tail.data(), tail.data() + tail.size(), signature) == tail.data() + tail.size() - kFunctionLength);
+
+	// Leading wildcards anchor on the first real byte
+	Signature wildcard_first = signature;
+	wildcard_first[0] = wildcard_first[1] = -1;
+	CHECK(Signature_Scan(tail.data(), tail.data() + tail.size(), wildcard_first) == tail.data() + tail.size() - kFunctionLength);
+
+	// Absent, too short a range, all wildcards
+	std::vector<uint8_t> empty = RandomText(0x1000, 5);
+	CHECK(Signature_Scan(empty.data(), empty.data() + empty.size(), signature) == nullptr);
+	CHECK(Signature_Scan(tail.data(), tail.data() + 8, signature) == nullptr);
+	CHECK(Signature_Scan(tail.data(), tail.data() + tail.size(), Signature(4, -1)) == nullptr);
+}
+
+void BenchmarkScan()
+{
+	std::vector<uint8_t> text = RandomText(32 << 20, 6);
+	PutFunction(text, text.size() / 2, 0x00812345, 0x00001000);
+	Signature signature = Signature_Learn(&text[text.size() / 2], kFunctionLength, kImageBase, kImageEnd);
+	const int runs = 10;
+	auto start = std::chrono::steady_clock::now();
+	const uint8_t* found = nullptr;
+	for (int i = 0; i < runs; i++)
+		found = Signature_Scan(text.data(), text.data() + text.size(), signature);
+	double seconds = SecondsSince(start);
+	CHECK(found == &text[text.size() / 2]);
+	printf("Signature_Scan: %.0f MB/s over a %u MB .text\n", runs * (text.size() >> 20) / seconds, (unsigned)(text.size() >> 20));
+}
+
+int main()
+{
+	TestLearn();
+	TestScan();
+	BenchmarkScan();
+	return test_failures;
+}